@@ -0,0 +1,64 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/trace.h"
+#include "util/spinlock.h"
+
+#include "proc/cpu.h"
+#include "proc/kthread.h"
+#include "proc/runq.h"
+
+cpu_t cpus[NCPUS];
+
+void
+cpu_init()
+{
+        int i;
+
+        for (i = 0; i < NCPUS; ++i) {
+                cpus[i].cpu_id = i;
+                cpus[i].cpu_thr = NULL;
+                cpus[i].cpu_fpuowner = NULL;
+                spinlock_init(&cpus[i].cpu_runqlock);
+                runq_init(&cpus[i].cpu_runq);
+        }
+}
+init_func(cpu_init);
+
+/*
+ * The victim is picked without holding any locks; rq_size may be stale
+ * by the time we lock it, in which case runq_steal() just comes back
+ * empty and the caller idles until the next try. A CPU with only one
+ * runnable thread is left alone since it is going to run that thread
+ * next anyway.
+ */
+kthread_t *
+cpu_steal(cpu_t *cpu)
+{
+        cpu_t *victim = NULL;
+        kthread_t *thr;
+        int i;
+
+        for (i = 0; i < NCPUS; ++i) {
+                if (&cpus[i] == cpu || cpus[i].cpu_runq.rq_size < 2)
+                        continue;
+                if (NULL == victim ||
+                    cpus[i].cpu_runq.rq_size > victim->cpu_runq.rq_size)
+                        victim = &cpus[i];
+        }
+        if (NULL == victim)
+                return NULL;
+
+        spinlock_lock(&victim->cpu_runqlock);
+        thr = runq_steal(&victim->cpu_runq);
+        spinlock_unlock(&victim->cpu_runqlock);
+
+        if (NULL != thr) {
+                thr->kt_cpu = cpu->cpu_id;
+                dbgt(DBG_SCHED, "cpu %d stole thread %p from cpu %d\n",
+                     cpu->cpu_id, (uint32_t)thr, victim->cpu_id);
+        }
+        return thr;
+}
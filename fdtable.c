@@ -0,0 +1,94 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+
+#include "fs/file.h"
+
+#include "proc/fdtable.h"
+
+#include "mm/slab.h"
+
+static slab_allocator_t *fdtable_allocator = NULL;
+
+void
+fdtable_init()
+{
+        fdtable_allocator = slab_allocator_create("fdtable", sizeof(fdtable_t));
+        KASSERT(NULL != fdtable_allocator);
+}
+init_func(fdtable_init);
+
+fdtable_t *
+fdtable_create()
+{
+        fdtable_t *ft;
+        int fd;
+
+        if (NULL == (ft = slab_obj_alloc(fdtable_allocator)))
+                return NULL;
+
+        ft->ft_refcount = 1;
+        for (fd = 0; fd < NFILES; ++fd)
+                ft->ft_files[fd] = NULL;
+        return ft;
+}
+
+void
+fdtable_ref(fdtable_t *ft)
+{
+        KASSERT(ft->ft_refcount > 0);
+
+        ft->ft_refcount++;
+}
+
+void
+fdtable_put(fdtable_t *ft)
+{
+        int fd;
+
+        KASSERT(ft->ft_refcount > 0);
+
+        if (--ft->ft_refcount > 0)
+                return;
+
+        for (fd = 0; fd < NFILES; ++fd) {
+                if (NULL != ft->ft_files[fd])
+                        fput(ft->ft_files[fd]);
+        }
+        slab_obj_free(fdtable_allocator, ft);
+}
+
+fdtable_t *
+fdtable_fork(fdtable_t *ft)
+{
+        fdtable_ref(ft);
+        return ft;
+}
+
+int
+fdtable_unshare(fdtable_t **ftp)
+{
+        fdtable_t *old = *ftp;
+        fdtable_t *copy;
+        int fd;
+
+        if (1 == old->ft_refcount)
+                return 0;
+
+        if (NULL == (copy = fdtable_create()))
+                return -ENOMEM;
+
+        for (fd = 0; fd < NFILES; ++fd) {
+                if (NULL != (copy->ft_files[fd] = old->ft_files[fd]))
+                        fref(copy->ft_files[fd]);
+        }
+
+        dbg(DBG_FREF, "unsharing file table %p (%d users)\n", old, old->ft_refcount);
+        fdtable_put(old);
+        *ftp = copy;
+        return 0;
+}
@@ -0,0 +1,167 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/string.h"
+
+#include "proc/cpu.h"
+#include "proc/fpu.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+
+#include "mm/slab.h"
+
+#define FPU_INTR        0x07    /* #NM, device not available */
+
+#define CR0_MP          0x00000002
+#define CR0_EM          0x00000004
+#define CR0_TS          0x00000008
+#define CR4_OSFXSR      0x00000200
+#define CR4_OSXMMEXCPT  0x00000400
+
+/* Slab objects are only word aligned, so areas carry 15 bytes of slack */
+#define FPU_ALIGN(area) ((void *)(((uintptr_t)(area) + 15) & ~(uintptr_t)15))
+
+static slab_allocator_t *fpu_allocator = NULL;
+
+static inline uint32_t
+fpu_getcr0(void)
+{
+        uint32_t cr0;
+
+        __asm__ volatile ("movl %%cr0, %0" : "=r" (cr0));
+        return cr0;
+}
+
+static inline void
+fpu_setcr0(uint32_t cr0)
+{
+        __asm__ volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+static inline void
+fpu_save(void *area)
+{
+        __asm__ volatile ("fxsave (%0)" : : "r" (FPU_ALIGN(area)) : "memory");
+}
+
+static inline void
+fpu_restore(void *area)
+{
+        __asm__ volatile ("fxrstor (%0)" : : "r" (FPU_ALIGN(area)) : "memory");
+}
+
+/*
+ * If there is no memory for the FPU area the process is killed through
+ * the usual cancellation path rather than from inside the trap. So
+ * that it does not trap again on every FPU instruction until then, the
+ * thread is given the FPU with no area to save it to; its state is
+ * simply dropped if it loses the FPU before it exits.
+ */
+static void
+fpu_trap(regs_t *regs)
+{
+        cpu_t *cpu = curcpu();
+        kthread_t *owner = cpu->cpu_fpuowner;
+
+        __asm__ volatile ("clts");
+        if (owner == curthr)
+                return;
+
+        if (NULL != owner && NULL != owner->kt_fpu)
+                fpu_save(owner->kt_fpu);
+
+        if (NULL != curthr->kt_fpu) {
+                fpu_restore(curthr->kt_fpu);
+        } else {
+                /* First use: a clean FPU, and somewhere to save it */
+                __asm__ volatile ("fninit");
+                curthr->kt_fpu = slab_obj_alloc(fpu_allocator);
+                if (NULL == curthr->kt_fpu) {
+                        dbg(DBG_ERROR, "no memory for FPU state of thread %p\n", curthr);
+                        curproc->p_status = -ENOMEM;
+                        kthread_cancel_proc(curproc, (void *)-ENOMEM);
+                        curthr->kt_retval = (void *)-ENOMEM;
+                        curthr->kt_cancelled = 1;
+                }
+        }
+        cpu->cpu_fpuowner = curthr;
+}
+
+void
+fpu_switch(kthread_t *next)
+{
+        cpu_t *cpu = curcpu();
+
+#ifdef __SMP__
+        if (cpu->cpu_fpuowner == curthr && NULL != curthr) {
+                if (NULL != curthr->kt_fpu)
+                        fpu_save(curthr->kt_fpu);
+                cpu->cpu_fpuowner = NULL;
+        }
+#endif
+        if (cpu->cpu_fpuowner == next)
+                __asm__ volatile ("clts");
+        else
+                fpu_setcr0(fpu_getcr0() | CR0_TS);
+}
+
+int
+fpu_clone(kthread_t *newthr, kthread_t *thr)
+{
+        newthr->kt_fpu = NULL;
+        if (NULL == thr->kt_fpu)
+                return 0;
+
+        newthr->kt_fpu = slab_obj_alloc(fpu_allocator);
+        if (NULL == newthr->kt_fpu)
+                return -ENOMEM;
+
+        /* The live copy may still be in the registers */
+        if (curcpu()->cpu_fpuowner == thr) {
+                __asm__ volatile ("clts");
+                fpu_save(thr->kt_fpu);
+                if (thr != curthr)
+                        fpu_setcr0(fpu_getcr0() | CR0_TS);
+        }
+        memcpy(FPU_ALIGN(newthr->kt_fpu), FPU_ALIGN(thr->kt_fpu), FPU_AREA_SIZE);
+        return 0;
+}
+
+void
+fpu_release(kthread_t *thr)
+{
+        int i;
+
+        for (i = 0; i < NCPUS; ++i) {
+                if (cpus[i].cpu_fpuowner == thr)
+                        cpus[i].cpu_fpuowner = NULL;
+        }
+        if (NULL != thr->kt_fpu) {
+                slab_obj_free(fpu_allocator, thr->kt_fpu);
+                thr->kt_fpu = NULL;
+        }
+}
+
+void
+fpu_init(void)
+{
+        uint32_t cr4;
+
+        fpu_allocator = slab_allocator_create("fpu", FPU_AREA_SIZE + 15);
+        KASSERT(NULL != fpu_allocator);
+
+        __asm__ volatile ("movl %%cr4, %0" : "=r" (cr4));
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        __asm__ volatile ("movl %0, %%cr4" : : "r" (cr4));
+
+        /* Nobody owns the FPU yet, so the first use traps */
+        fpu_setcr0((fpu_getcr0() & ~CR0_EM) | CR0_MP | CR0_TS);
+        intr_register(FPU_INTR, fpu_trap);
+}
+init_func(fpu_init);
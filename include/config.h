@@ -6,8 +6,34 @@
  * kernel configuration parameters
  */
 #define DEFAULT_STACK_SIZE      (56*1024) /* size of stacks */
+#define MEDIUM_STACK_SIZE       (24*1024) /* size of KT_STACK_MEDIUM stacks */
+#define SMALL_STACK_SIZE        (8*1024)  /* size of KT_STACK_SMALL stacks */
 #define TICK_MSECS              10        /* msecs between clock interrupts */
 
+#ifdef __SMP__
+#define NCPUS                   8         /* max number of CPUs supported */
+#else
+#define NCPUS                   1
+#endif
+
+#define KSTACK_CACHE_HIWAT      16        /* max free stacks kept for reuse */
+#define SLAB_MAGAZINE_SIZE      32        /* free objects kept per CPU per cache */
+#define REAPD_BATCH             16        /* dead threads per reaper wakeup */
+#define REAPD_INTERVAL          100       /* ticks between reaper passes */
+#define TIMER_WHEEL_SLOTS       256       /* timer wheel size, a power of 2 */
+#define KMUTEX_SPIN_LIMIT       1000      /* spins on a running holder before sleeping */
+#define KMUTEX_PI_DEPTH         16        /* longest chain of holders boosted */
+#define TRACE_RING_SIZE         1024      /* trace records kept per CPU, a power of 2 */
+#define WORKQ_MIN_WORKERS       1         /* workqueue threads kept while idle */
+#define WORKQ_MAX_WORKERS       8         /* most workqueue threads at once (__MTP__ only) */
+#define WORKQ_IDLE_TICKS        500       /* idle ticks before a spare worker exits */
+#define INIT_NWORKERS           4         /* threads running init functions at once */
+
+/*
+ * Process-related:
+ */
+#define PID_HASH_SIZE           1024      /* buckets in the PID hash, a power of 2 */
+
 /*
  * Memory-management-related:
  */
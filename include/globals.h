@@ -3,5 +3,14 @@
 #include "proc/kthread.h"
 #include "proc/proc.h"
 
+#ifdef __SMP__
+#include "proc/cpu.h"
+
+#define curthr (curcpu()->cpu_thr)
+#elif defined(__KSTACK_TCB__)
+/* The thread sits at the top of its own stack block, see kthread.h */
+#define curthr (kthread_self())
+#else
 extern kthread_t *curthr;
+#endif
 extern proc_t *curproc;
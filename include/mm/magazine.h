@@ -0,0 +1,78 @@
+#pragma once
+
+#include "config.h"
+#include "types.h"
+
+#include "mm/slab.h"
+
+/*
+ * A per-CPU magazine layer in front of a slab allocator. Each CPU keeps
+ * a small stack of free objects, so allocating and freeing an object is
+ * usually a push or pop on the local CPU's stack and never reaches the
+ * shared slab. Objects only go back to the slab when a magazine
+ * overflows or is drained. With SLAB_CHECK_FREE a push also checks
+ * that the object is not already in one of the magazines; a double
+ * free of an object that went back to the slab is caught by the slab
+ * once the second copy is flushed.
+ */
+typedef struct slab_magazine {
+        slab_allocator_t *sm_slab;
+        struct slab_magazine_cpu {
+                int     smc_count;
+                void   *smc_objs[SLAB_MAGAZINE_SIZE];
+        } sm_cpu[NCPUS];
+} slab_magazine_t;
+
+/**
+ * Initializes a magazine layer in front of a slab allocator.
+ *
+ * @param mag the magazine
+ * @param slab the slab allocator objects come from
+ */
+void slab_magazine_init(slab_magazine_t *mag, slab_allocator_t *slab);
+
+/**
+ * Allocates one object, from the local magazine if possible.
+ *
+ * @param mag the magazine
+ * @return the object, or NULL if there is not enough memory
+ */
+void *slab_magazine_alloc(slab_magazine_t *mag);
+
+/**
+ * Frees one object into the local magazine, or to the slab if the
+ * magazine is full.
+ *
+ * @param mag the magazine
+ * @param obj the object to free
+ */
+void slab_magazine_free(slab_magazine_t *mag, void *obj);
+
+/**
+ * Allocates n objects in one call.
+ *
+ * @param mag the magazine
+ * @param objs receives the objects
+ * @param n the number of objects wanted
+ * @return 0 on success, or -ENOMEM if they could not all be
+ * allocated, in which case none are
+ */
+int slab_magazine_alloc_n(slab_magazine_t *mag, void **objs, int n);
+
+/**
+ * Frees n objects in one call.
+ *
+ * @param mag the magazine
+ * @param objs the objects to free
+ * @param n the number of objects
+ */
+void slab_magazine_free_n(slab_magazine_t *mag, void **objs, int n);
+
+/**
+ * Returns every object in the local magazine to the slab, so that
+ * slab_allocators_reclaim can get at them.
+ *
+ * @param mag the magazine
+ * @return the number of objects returned
+ */
+int slab_magazine_drain(slab_magazine_t *mag);
@@ -48,7 +48,37 @@ void  page_free(void *addr);
 void *page_alloc_n(uint32_t npages);
 void  page_free_n(void *start, uint32_t npages);
 
+/* Zero and copy a whole page, PAGE_SIZE / 4 words at a time. Both
+ * addresses must be page aligned. */
+static inline void
+page_zero(void *page)
+{
+        int d0, d1;
+
+        __asm__ volatile ("rep stosl"
+                          : "=&c" (d0), "=&D" (d1)
+                          : "0" (PAGE_SIZE / 4), "1" (page), "a" (0)
+                          : "memory");
+}
+
+static inline void
+page_copy(void *dst, const void *src)
+{
+        int d0, d1, d2;
+
+        __asm__ volatile ("rep movsl"
+                          : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+                          : "0" (PAGE_SIZE / 4), "1" (dst), "2" (src)
+                          : "memory");
+}
+
 /* Returns the number of free pages remaining in the
  * system. Note that calls to page_alloc_n(npages) may
- * fail even if page_free_count() >= npages. */
+ * fail even if page_free_count() >= npages, and always
+ * fail for npages > (1 << (PAGE_NSIZES - 1)). */
 uint32_t page_free_count();
+
+/* A dbg_infofunc_t showing how fragmented free memory is:
+ * the number of free blocks of each size, and the largest
+ * one. arg must be NULL. */
+size_t page_info(const void *arg, char *buf, size_t osize);
@@ -1,5 +1,8 @@
 #pragma once
 
+/* The debugging below costs on every allocation, so like KASSERT it is
+ * left out of NDEBUG builds. */
+#ifndef NDEBUG
 /* Define SLAB_REDZONE to add top and bottom redzones to every object.
  * Use kmem_check_redzones() liberally throughout your code to test
  * for memory pissing. */
@@ -8,6 +11,7 @@
 /* Define SLAB_CHECK_FREE to add extra book keeping to make sure there
  * are no double frees. */
 #define SLAB_CHECK_FREE
+#endif
 
 /*
  * The slab allocator. A "cache" is a store of objects; you create one by
@@ -24,3 +28,6 @@ int slab_allocators_reclaim(int target);
 
 void *slab_obj_alloc(slab_allocator_t *allocator);
 void slab_obj_free(slab_allocator_t *allocator, void *obj);
+
+/* For hot caches, see mm/magazine.h for a per-CPU layer on top of
+ * these. */
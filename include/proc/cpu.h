@@ -0,0 +1,50 @@
+#pragma once
+
+#include "config.h"
+
+#include "util/spinlock.h"
+
+#include "proc/runq.h"
+
+struct kthread;
+
+/*
+ * Per-CPU scheduler state. Each CPU runs threads off its own run queue
+ * and only takes another CPU's cpu_runqlock when it has run dry and
+ * goes looking for work to steal.
+ */
+typedef struct cpu {
+        int             cpu_id;
+        struct kthread *cpu_thr;        /* thread running on this CPU */
+        struct kthread *cpu_fpuowner;   /* thread whose state is in the FPU, see proc/fpu.h */
+        spinlock_t      cpu_runqlock;   /* protects cpu_runq */
+        ktrunq_t        cpu_runq;       /* threads waiting for this CPU */
+} cpu_t;
+
+extern cpu_t cpus[NCPUS];
+
+#ifdef __SMP__
+/* Index of the CPU we are running on, from the local APIC */
+int apic_current_cpu(void);
+#define curcpu()        (&cpus[apic_current_cpu()])
+#else
+#define curcpu()        (&cpus[0])
+#endif
+
+/**
+ * Initializes the per-CPU state of every CPU, including those not
+ * brought up yet; they find their cpu_t ready when they start. Run by
+ * init_call_all, so anything that puts threads on a run queue at init
+ * time must init_depends(cpu_init).
+ */
+void cpu_init(void);
+
+/**
+ * Steals a runnable thread for an idle CPU from the tail of the
+ * busiest other CPU's run queue.
+ *
+ * @param cpu the CPU looking for work
+ * @return the stolen thread, now belonging to cpu, or NULL if no other
+ * CPU had a thread to spare
+ */
+struct kthread *cpu_steal(cpu_t *cpu);
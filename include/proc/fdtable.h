@@ -0,0 +1,65 @@
+#pragma once
+
+#include "config.h"
+
+struct file;
+
+/*
+ * A process's table of open files. It lives outside of proc_t so that
+ * the struct stays small, and it is reference counted so that fork can
+ * share it between parent and child instead of copying it. The copy is
+ * only made when one of them changes its table while it is still
+ * shared, which a child that goes straight to exec never does.
+ *
+ * The table holds one reference on each file in ft_files, no matter
+ * how many processes share the table.
+ */
+typedef struct fdtable {
+        int             ft_refcount;
+        struct file    *ft_files[NFILES];
+} fdtable_t;
+
+void fdtable_init(void);
+
+/**
+ * Allocates an empty file table with a reference count of 1.
+ *
+ * @return the new table, or NULL if there is not enough memory
+ */
+fdtable_t *fdtable_create(void);
+
+/**
+ * Takes another reference to a file table.
+ *
+ * @param ft the table
+ */
+void fdtable_ref(fdtable_t *ft);
+
+/**
+ * Drops a reference to a file table. When the last one goes, the
+ * files still in it are released and the table is freed.
+ *
+ * @param ft the table
+ */
+void fdtable_put(fdtable_t *ft);
+
+/**
+ * Shares a file table with a newly forked child. This costs the same
+ * no matter how many files are open.
+ *
+ * @param ft the parent's table
+ * @return the table for the child, which is ft itself
+ */
+fdtable_t *fdtable_fork(fdtable_t *ft);
+
+/**
+ * Makes sure a process has a file table of its own before it changes
+ * it. Must be called before any store to (*ftp)->ft_files. If the table
+ * is shared, it is copied, taking a reference on every open file, and
+ * the process's reference moves to the copy.
+ *
+ * @param ftp where the process keeps its table, usually &p->p_files
+ * @return 0 on success or -ENOMEM if the copy could not be made,
+ * in which case *ftp is left alone
+ */
+int fdtable_unshare(fdtable_t **ftp);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "types.h"
+
+struct kthread;
+
+/*
+ * Lazy FPU/SSE state switching. A CPU's FPU registers belong to
+ * whichever thread last used them, its cpu_fpuowner. Switching to any
+ * other thread just sets CR0.TS, so that thread's first FPU instruction
+ * traps (#NM); only then is the owner's state saved and the new
+ * thread's loaded. A thread gets its FXSAVE area, kt_fpu, on that
+ * first trap, so threads that never touch the FPU carry none.
+ *
+ * Under __SMP__ a thread's state is saved when it is switched out,
+ * since it may next run on another CPU; loading stays lazy.
+ */
+
+#define FPU_AREA_SIZE   512     /* FXSAVE image, needs 16 byte alignment */
+
+/**
+ * Enables FXSAVE and the #NM trap. Called once at boot.
+ */
+void fpu_init(void);
+
+/**
+ * Must be called by sched_switch() just before it switches from curthr
+ * to next.
+ *
+ * @param next the thread about to run
+ */
+void fpu_switch(struct kthread *next);
+
+/**
+ * Gives a clone a copy of thr's FPU state, if thr has any.
+ *
+ * @param newthr the clone, whose kt_fpu is overwritten
+ * @param thr the thread being cloned
+ * @return 0 on success, -ENOMEM if there was no memory for the copy
+ */
+int fpu_clone(struct kthread *newthr, struct kthread *thr);
+
+/**
+ * Frees a dying thread's FPU area and forgets it as an owner.
+ *
+ * @param thr the thread
+ */
+void fpu_release(struct kthread *thr);
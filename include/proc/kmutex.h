@@ -0,0 +1,61 @@
+#pragma once
+
+#include "util/list.h"
+#include "util/spinlock.h"
+
+#include "proc/sched.h"
+
+struct kthread;
+
+typedef struct kmutex {
+        struct kthread *km_holder;      /* current holder, NULL if unlocked */
+        ktqueue_t       km_waitq;       /* threads waiting for the mutex */
+        list_link_t     km_link;        /* link on the holder's kt_mutexes */
+        spinlock_t      km_lock;        /* protects km_holder and km_waitq */
+} kmutex_t;
+
+/**
+ * Initializes the fields of the specified kmutex_t.
+ *
+ * @param mtx the mutex to initialize
+ */
+void kmutex_init(kmutex_t *mtx);
+
+/**
+ * Takes the mutex if nobody holds it. Never sleeps.
+ *
+ * @param mtx the mutex to take
+ * @return 1 if we now hold the mutex and 0 otherwise
+ */
+int kmutex_trylock(kmutex_t *mtx);
+
+/**
+ * Waits until the specified mutex is available, then takes it. An
+ * uncontended lock never touches the wait queue. On SMP the caller
+ * spins for a while first if the holder is running on another CPU,
+ * since the mutex is likely to be released soon. A thread that has to
+ * sleep lends its priority to the holder, and on down the chain of
+ * holders that are themselves waiting on mutexes, until the mutex is
+ * released.
+ *
+ * @param mtx the mutex to lock
+ */
+void kmutex_lock(kmutex_t *mtx);
+
+/**
+ * Like kmutex_lock, but the sleep can be cancelled.
+ *
+ * @param mtx the mutex to lock
+ * @return 0 if the mutex was taken and -EINTR if the thread was
+ * cancelled while waiting
+ */
+int kmutex_lock_cancellable(kmutex_t *mtx);
+
+/**
+ * Releases the mutex. If anybody is waiting, the mutex is handed
+ * straight to the longest waiter, which is woken up already holding
+ * it.
+ *
+ * @param mtx the mutex to unlock
+ */
+void kmutex_unlock(kmutex_t *mtx);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "proc/sched.h"
+
+struct kthread;
+
+/*
+ * A sleeping reader-writer lock for read-mostly data. Any number of
+ * readers may hold it at once. Writers take priority: once a writer is
+ * waiting, new readers queue up behind it, so a steady stream of
+ * readers cannot starve writers.
+ */
+typedef struct krwlock {
+        int             rw_readers;     /* readers holding the lock */
+        struct kthread *rw_writer;      /* writer holding the lock, or NULL */
+        int             rw_wwaiting;    /* writers waiting for the lock */
+        ktqueue_t       rw_rwaitq;      /* readers waiting for the lock */
+        ktqueue_t       rw_wwaitq;      /* writers waiting for the lock */
+} krwlock_t;
+
+/**
+ * Initializes the fields of the specified krwlock_t.
+ *
+ * @param rw the lock to initialize
+ */
+void krwlock_init(krwlock_t *rw);
+
+/**
+ * Takes the lock for reading, waiting while a writer holds it or is
+ * waiting for it.
+ *
+ * @param rw the lock
+ */
+void krwlock_read_lock(krwlock_t *rw);
+
+/**
+ * Releases a read hold on the lock.
+ *
+ * @param rw the lock
+ */
+void krwlock_read_unlock(krwlock_t *rw);
+
+/**
+ * Takes the lock for writing, waiting until nobody else holds it.
+ *
+ * @param rw the lock
+ */
+void krwlock_write_lock(krwlock_t *rw);
+
+/**
+ * Releases a write hold on the lock. Waiting writers go first; the
+ * waiting readers are only let in once none are left.
+ *
+ * @param rw the lock
+ */
+void krwlock_write_unlock(krwlock_t *rw);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "types.h"
+
+#include "proc/kmutex.h"
+
+/*
+ * A sequence lock for small, hot records that are read far more often
+ * than they are written. Readers never block or write shared memory;
+ * they copy the record and retry if a writer got in meanwhile:
+ *
+ *    uint32_t seq;
+ *    do {
+ *        seq = kseqlock_read_begin(&sl);
+ *        ... copy the record ...
+ *    } while (kseqlock_read_retry(&sl, seq));
+ *
+ * Writers are serialized by a kmutex_t and bump the sequence number on
+ * the way in and out, so it is odd while a write is in progress. A
+ * writer must not sleep before unlocking, since readers spin while the
+ * sequence number is odd.
+ * Readers must not follow pointers out of the record, since it may
+ * change under them.
+ */
+typedef struct kseqlock {
+        volatile uint32_t       sl_seq;
+        kmutex_t                sl_wlock;
+} kseqlock_t;
+
+#define kseqlock_init(sl)                                               \
+        do {                                                            \
+                (sl)->sl_seq = 0;                                       \
+                kmutex_init(&(sl)->sl_wlock);                           \
+        } while (0)
+
+static inline uint32_t
+kseqlock_read_begin(kseqlock_t *sl)
+{
+        uint32_t seq;
+
+        while ((seq = sl->sl_seq) & 1)
+                ;
+        __sync_synchronize();
+        return seq;
+}
+
+static inline int
+kseqlock_read_retry(kseqlock_t *sl, uint32_t seq)
+{
+        __sync_synchronize();
+        return sl->sl_seq != seq;
+}
+
+static inline void
+kseqlock_write_lock(kseqlock_t *sl)
+{
+        kmutex_lock(&sl->sl_wlock);
+        sl->sl_seq++;
+        __sync_synchronize();
+}
+
+static inline void
+kseqlock_write_unlock(kseqlock_t *sl)
+{
+        __sync_synchronize();
+        sl->sl_seq++;
+        kmutex_unlock(&sl->sl_wlock);
+}
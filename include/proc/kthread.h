@@ -1,7 +1,11 @@
 #pragma once
 
+#include "config.h"
+
 #include "util/list.h"
 
+#include "mm/page.h"
+
 #include "proc/sched.h"
 #include "proc/context.h"
 
@@ -17,10 +21,20 @@ typedef enum
         KT_EXITED              /* has exited, waiting to be joined */
 } kthread_state_t;
 
+/* kernel stack size classes, see the *_STACK_SIZE values in config.h */
+typedef enum
+{
+        KT_STACK_SMALL,        /* SMALL_STACK_SIZE, for tiny daemons */
+        KT_STACK_MEDIUM,       /* MEDIUM_STACK_SIZE */
+        KT_STACK_DEFAULT,      /* DEFAULT_STACK_SIZE */
+        KT_STACK_NCLASSES
+} kthread_stack_class_t;
+
 struct proc;
 typedef struct kthread {
         context_t       kt_ctx;         /* this thread's context */
         char           *kt_kstack;      /* the kernel stack */
+        kthread_stack_class_t kt_stackclass; /* size class of kt_kstack */
         void           *kt_retval;      /* this thread's return value */
         int             kt_errno;       /* error no. of most recent syscall */
         struct proc    *kt_proc;        /* the thread's process */
@@ -29,6 +43,14 @@ typedef struct kthread {
         ktqueue_t      *kt_wchan;       /* The queue that this thread is blocked on */
         kthread_state_t kt_state;       /* this thread's state */
 
+        int             kt_prio;        /* current priority, see proc/runq.h */
+        int             kt_baseprio;    /* priority kt_prio returns to once run */
+        int             kt_inheritprio; /* inherited from kt_mutexes waiters */
+        uint32_t        kt_runqstamp;   /* run queue tick at which we were queued */
+        int             kt_cpu;         /* CPU whose run queue we belong to */
+        ktstats_t       kt_stats;       /* switch and wait counters, see proc/sched.h */
+        void           *kt_fpu;         /* FXSAVE area, NULL until first FPU use */
+
         /*
          * This is the thread's link on a queue. Every thread must
          * either be on a queue, or running, or else the thread will be lost
@@ -36,12 +58,41 @@ typedef struct kthread {
          */
         list_link_t     kt_qlink;       /* link on ktqueue */
         list_link_t     kt_plink;       /* link on proc thread list, p_threads */
+        list_t          kt_mutexes;     /* kmutexes we hold, linked by km_link */
+        struct kmutex  *kt_blockedon;   /* kmutex whose km_waitq is our kt_wchan */
 #ifdef __MTP__
         int             kt_detached;    /* if the thread has been detached */
         ktqueue_t       kt_joinq;       /* thread waiting to join with this thread */
 #endif
 } kthread_t;
 
+#ifdef __KSTACK_TCB__
+/*
+ * With __KSTACK_TCB__ each kthread_t lives in the top page of its own
+ * kernel stack block, above the stack and its "magic" guard page. The block
+ * is a power of two in size and the page allocator hands it out aligned
+ * to that size, so the running thread can be found from the stack
+ * pointer alone.
+ */
+#define KSTACK_BLOCK_SIZE       (DEFAULT_STACK_SIZE + 2 * PAGE_SIZE)
+#define KSTACK_TCB(kstack)                                              \
+        ((kthread_t *)((char *)(kstack) + KSTACK_BLOCK_SIZE - PAGE_SIZE))
+
+/**
+ * Returns the thread whose kernel stack we are running on. Only valid
+ * once the first thread has been switched to.
+ *
+ * @return the current thread
+ */
+static inline kthread_t *
+kthread_self(void)
+{
+        uintptr_t sp;
+        __asm__ volatile ("movl %%esp, %0" : "=r" (sp));
+        return KSTACK_TCB(sp & ~(KSTACK_BLOCK_SIZE - 1));
+}
+#endif
+
 void kthread_init(void);
 
 /**
@@ -56,6 +107,30 @@ void kthread_init(void);
  */
 kthread_t *kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2);
 
+/**
+ * Allocates and initializes a kernel thread with a stack from the
+ * given size class instead of DEFAULT_STACK_SIZE.
+ *
+ * @param p the process in which the thread will run
+ * @param func the function that will be called when the newly created
+ * thread starts executing
+ * @param arg1 the first argument to func
+ * @param arg2 the second argument to func
+ * @param sclass the size class of the thread's kernel stack
+ * @return the newly created thread
+ */
+kthread_t *kthread_create_stack(struct proc *p, kthread_func_t func, long arg1, void *arg2,
+                                kthread_stack_class_t sclass);
+
+/**
+ * Sets the priority of a thread. Takes effect the next time the thread
+ * is put on the run queue.
+ *
+ * @param kthr the thread
+ * @param prio the new priority, between KT_PRIO_MAX and KT_PRIO_MIN
+ */
+void kthread_setprio(kthread_t *kthr, int prio);
+
 /**
  * Free resources associated with a thread.
  *
@@ -71,6 +146,31 @@ void kthread_destroy(kthread_t *t);
  */
 void kthread_cancel(kthread_t *kthr, void *retval);
 
+/**
+ * Cancels every thread of a process except the caller in one pass:
+ * each is flagged, and those in a cancellable sleep are taken off
+ * their queue and made runnable, so they exit themselves. Under
+ * __MTP__ threads nobody is joining are detached first, so reapd frees
+ * them rather than their process's last exit. Threads sleeping
+ * uncancellably notice when they next check kt_cancelled.
+ * proc_kill() should use this rather than kthread_cancel() per thread.
+ *
+ * @param p the process
+ * @param retval the return value for the threads
+ * @return the number of threads woken
+ */
+int kthread_cancel_proc(struct proc *p, void *retval);
+
+/**
+ * kthread_cancel_proc() for every process proc_kill_all() would kill:
+ * all but the idle process, its direct children and the caller's own
+ * process, which is left for the caller to exit.
+ *
+ * @param retval the return value for the threads
+ * @return the number of threads woken
+ */
+int kthread_cancel_all(void *retval);
+
 /**
  * Exits the current thread.
  *
@@ -86,6 +186,40 @@ void kthread_exit(void *retval);
  */
 kthread_t *kthread_clone(kthread_t *thr);
 
+/**
+ * Checks the guard page below a thread's kernel stack for signs that
+ * the stack overflowed. Only the few words at the top of the guard
+ * page, right below the stack, are looked at, which keeps the check
+ * cheap enough to call on every context switch while chasing a
+ * suspected overflow. A single frame big enough to jump over them is
+ * not caught.
+ *
+ * @param t the thread whose stack to check
+ * @return 1 if the top of the guard page is untouched, 0 otherwise
+ */
+int kthread_stack_intact(kthread_t *t);
+
+/**
+ * Provides scheduling statistics for a thread: context switches,
+ * wakeups and the time spent waiting to run and asleep.
+ *
+ * @param arg a pointer to the thread
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t kthread_info(const void *arg, char *buf, size_t osize);
+
+/**
+ * Returns the calling CPU's cached free kernel stacks to the page
+ * allocator, and its cached free kthread_ts to their slab. Meant to be
+ * called from slab_allocators_reclaim() when memory runs low.
+ *
+ * @param target the number of pages to free, or 0 to empty the cache
+ * @return the number of pages actually freed
+ */
+int kthread_stack_reclaim(int target);
+
 #ifdef __MTP__
 /**
  * Shuts down the reaper daemon.
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "types.h"
+
+struct proc;
+
+/*
+ * PID allocation and lookup. Free PIDs are tracked in a bitmap with one
+ * bit per possible PID, which is searched a word at a time starting
+ * just past the last PID handed out, so PIDs are not reused straight
+ * away. Live processes are kept in a hash table keyed by PID, linked
+ * through p_hash_link, so finding one does not walk the process list.
+ */
+
+void pid_init(void);
+
+/**
+ * Allocates an unused PID.
+ *
+ * @return the new PID, or -EAGAIN if all PROC_MAX_COUNT are in use
+ */
+pid_t pid_alloc(void);
+
+/**
+ * Returns a PID allocated with pid_alloc to the pool. The process with
+ * that PID must already have been taken out of the hash table.
+ *
+ * @param pid the PID to free
+ */
+void pid_free(pid_t pid);
+
+/**
+ * Adds a process to the PID hash table under its p_pid. Should be done
+ * by proc_create once the PID is assigned.
+ *
+ * @param p the process
+ */
+void pid_hash_insert(struct proc *p);
+
+/**
+ * Removes a process from the PID hash table. Should be done when the
+ * process is cleaned up, before pid_free.
+ *
+ * @param p the process
+ */
+void pid_hash_remove(struct proc *p);
+
+/**
+ * Finds the process with the specified PID in O(1). Only processes
+ * added with pid_hash_insert are found.
+ *
+ * @param pid the PID of the process to find
+ * @return a pointer to the process with PID pid, or NULL if there is
+ * no such process
+ */
+struct proc *pid_lookup(pid_t pid);
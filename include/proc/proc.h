@@ -2,6 +2,7 @@
 
 #include "types.h"
 
+#include "proc/fdtable.h"
 #include "proc/kthread.h"
 
 #include "mm/pagetable.h"
@@ -13,6 +14,9 @@
 #define PROC_MAX_COUNT  65536
 #define PROC_NAME_LEN   256
 
+/* do_waitpid_n options */
+#define WNOHANG         1       /* return at once if no child has exited */
+
 struct regs;
 
 /* Process states. */
@@ -23,16 +27,13 @@ typedef enum
 } proc_state_t;
 
 typedef struct proc {
-        pid_t           p_pid;                 /* our pid */
-        char            p_comm[PROC_NAME_LEN]; /* process name */
-
-        list_t          p_threads;       /* the process's thread list */
-        list_t          p_children;      /* the process's children list */
-        struct proc    *p_pproc;         /* our parent process */
-
-        int             p_status;        /* exit status */
+        /*
+         * Fields the scheduler and the wait/exit paths touch come first,
+         * so that they share the first cache line of the struct.
+         */
+        pid_t           p_pid;           /* our pid */
         proc_state_t    p_state;         /* running/sleeping/etc. */
-
+        list_t          p_threads;       /* the process's thread list */
 
         /*
          * This is the queue a process puts itself on when it wants to wait on
@@ -41,14 +42,19 @@ typedef struct proc {
          * See do_waitpid in proc.c for more details.
         */
         ktqueue_t       p_wait;          /* queue for wait(2) */
-
+        struct proc    *p_pproc;         /* our parent process */
+        int             p_status;        /* exit status */
+        list_t          p_children;      /* the process's children list */
         pagedir_t      *p_pagedir;
 
         list_link_t     p_list_link;     /* link on the list of all processes */
         list_link_t     p_child_link;    /* link on parent process' p_children list */
+        list_link_t     p_hash_link;     /* link on the PID hash chain, see proc/pid.h */
+
+        char           *p_comm;          /* process name, kmalloc'd by proc_create */
 
         /* VFS-related: */
-        struct file    *p_files[NFILES]; /* open files */
+        fdtable_t      *p_files;         /* open files, see proc/fdtable.h */
         struct vnode   *p_cwd;           /* current working dir */
 
         /* VM */
@@ -106,7 +112,8 @@ void proc_kill_all(void);
 
 /**
  * Alerts the process that the currently executing thread has just
- * exited.
+ * exited. A detached thread has already been taken off p_threads and
+ * handed to the reaper by then; it must not be destroyed here.
  *
  * @param retval the return value for the current thread
  */
@@ -131,6 +138,33 @@ void do_exit(int status);
  */
 pid_t do_waitpid(pid_t pid, int options, int *status);
 
+/**
+ * Cleans up a dead child of the current process once it has been
+ * found: takes it off p_children, destroys its remaining threads and
+ * frees it. This is the part of do_waitpid that comes after the
+ * search, so a caller that already holds the child can skip that.
+ *
+ * @param child a PROC_DEAD child of curproc, freed on return
+ * @param status used to return the exit status of the child
+ * @return the pid the child had
+ */
+pid_t proc_reap(proc_t *child, int *status);
+
+/**
+ * Collects up to n dead children in one call, cleaning each of them up
+ * as do_waitpid would.
+ *
+ * @param options 0, or WNOHANG to return 0 at once instead of
+ * sleeping when no child has exited yet
+ * @param pids filled in with the pids of the children collected
+ * @param statuses filled in with the matching exit statuses
+ * @param n the size of pids and statuses
+ *
+ * @return the number of children collected, -ECHILD if this process
+ * has no children, or -EINVAL for unsupported options
+ */
+int do_waitpid_n(int options, pid_t *pids, int *statuses, int n);
+
 /**
  * This function implements the fork(2) system call.
  *
@@ -138,6 +172,22 @@ pid_t do_waitpid(pid_t pid, int options, int *status);
  */
 int do_fork(struct regs *regs);
 
+/**
+ * Creates a child process running a new program, without the fork
+ * that would otherwise come before the exec. The child gets a fresh
+ * thread instead of a clone of ours, starts with an empty address
+ * space, and shares our open files. We block until the child has
+ * loaded the program, so the arguments only need to stay valid until
+ * this returns.
+ *
+ * @param filename the program to run, in kernel memory
+ * @param argv the argument vector, in kernel memory
+ * @param envp the environment, in kernel memory
+ * @return the pid of the child, or the error from loading the program,
+ * in which case no child is left behind
+ */
+int do_spawn(const char *filename, char *const *argv, char *const *envp);
+
 /**
  * Provides detailed debug information about a given process.
  *
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "types.h"
+
+#include "proc/sched.h"
+
+/*
+ * Thread priorities. Lower numbers are more urgent: KT_PRIO_MAX is the
+ * most urgent level and KT_NPRIO - 1 the least. New threads start at
+ * KT_PRIO_DEFAULT.
+ */
+#define KT_NPRIO                32      /* must fit in rq_bitmap */
+#define KT_PRIO_MAX             0
+#define KT_PRIO_DEFAULT         16
+#define KT_PRIO_MIN             (KT_NPRIO - 1)
+#define KT_PRIO_NONE            KT_NPRIO        /* nothing inherited */
+
+/*
+ * The priority a thread runs at when not aged: its own, or the one it
+ * inherited from a more urgent thread waiting on a mutex it holds.
+ */
+#define KT_EFFECTIVE_PRIO(thr)                                          \
+        ((thr)->kt_inheritprio < (thr)->kt_baseprio ?                   \
+         (thr)->kt_inheritprio : (thr)->kt_baseprio)
+
+/*
+ * A thread that has sat at the head of its run queue level for this
+ * many runq_tick()s is moved up one level, so that a steady stream of
+ * urgent threads cannot starve the rest forever.
+ */
+#define RUNQ_AGE_TICKS          8
+
+struct kthread;
+
+/*
+ * A multi-level run queue: one FIFO ktqueue_t per priority level plus
+ * a bitmap of the non-empty levels, so that finding the most urgent
+ * runnable thread is a single bit scan.
+ */
+typedef struct ktrunq {
+        uint32_t        rq_bitmap;              /* bit i set iff rq_queues[i] is not empty */
+        ktqueue_t       rq_queues[KT_NPRIO];
+        int             rq_size;                /* threads on all levels */
+        uint32_t        rq_ticks;               /* runq_tick() calls so far */
+} ktrunq_t;
+
+/**
+ * Initializes a run queue.
+ *
+ * @param rq the run queue
+ */
+void runq_init(ktrunq_t *rq);
+
+/**
+ * Returns true if the run queue is empty.
+ *
+ * @param rq the run queue
+ * @return true if the run queue is empty
+ */
+int runq_empty(ktrunq_t *rq);
+
+/**
+ * Adds a thread to the tail of the level for its current priority.
+ *
+ * @param rq the run queue
+ * @param thr the thread to add
+ */
+void runq_enqueue(ktrunq_t *rq, struct kthread *thr);
+
+/**
+ * Adds a thread to the head of the level for its current priority, so
+ * it runs before anything else already waiting at that level.
+ *
+ * @param rq the run queue
+ * @param thr the thread to add
+ */
+void runq_enqueue_head(ktrunq_t *rq, struct kthread *thr);
+
+/**
+ * Removes and returns the most urgent thread on the run queue. The
+ * thread gets its effective priority back, undoing any aging.
+ *
+ * @param rq the run queue
+ * @return the removed thread, or NULL if the run queue is empty
+ */
+struct kthread *runq_dequeue(ktrunq_t *rq);
+
+/**
+ * Removes the thread that would run last among the most urgent
+ * runnable ones, for handing to another CPU. The head of the level is
+ * left for the owning CPU. Like runq_dequeue, resets the thread's
+ * priority from any aging it had on this run queue.
+ *
+ * @param rq the run queue
+ * @return the removed thread, or NULL if no level holds more than the
+ * thread at its head
+ */
+struct kthread *runq_steal(ktrunq_t *rq);
+
+/**
+ * Removes a specific thread from the run queue.
+ *
+ * @param rq the run queue the thread is on
+ * @param thr the thread to remove
+ */
+void runq_remove(ktrunq_t *rq, struct kthread *thr);
+
+/**
+ * Changes a thread's current priority, moving it to the matching level
+ * if it is waiting on this run queue.
+ *
+ * @param rq the run queue the thread may be on
+ * @param thr the thread
+ * @param prio the new priority
+ */
+void runq_setprio(ktrunq_t *rq, struct kthread *thr, int prio);
+
+/**
+ * Advances the run queue's clock by one tick and ages threads that
+ * have waited too long at their level. Should be called once per
+ * clock interrupt.
+ *
+ * @param rq the run queue
+ */
+void runq_tick(ktrunq_t *rq);
@@ -1,7 +1,28 @@
 #pragma once
 
+#include "types.h"
+
 #include "util/list.h"
 
+/*
+ * Scheduling statistics. Every thread records how long it waits each
+ * time it goes on a queue, split into time spent runnable on a run
+ * queue and time spent asleep. With __SCHED_STATS__ each queue also
+ * gets a histogram of those waits, kept in a table in ktqueue.c so
+ * ktqueue_t itself does not grow. Bucket i counts waits of fewer than
+ * 16^(i + 1) cycles; the last bucket counts everything longer.
+ */
+#define KTQUEUE_HIST_BUCKETS    8
+
+typedef struct ktstats {
+        uint64_t        ks_qstamp;      /* cycle count when we went on kt_wchan */
+        uint64_t        ks_runqwait;    /* cycles spent runnable, waiting for a CPU */
+        uint64_t        ks_sleeptime;   /* cycles spent asleep on other queues */
+        uint32_t        ks_nvcsw;       /* times we went to sleep */
+        uint32_t        ks_nivcsw;      /* times we went back on the run queue */
+        uint32_t        ks_nwakeups;    /* times we were taken off a sleep queue */
+} ktstats_t;
+
 struct kthread;
 typedef struct ktqueue {
         list_t          tq_list;
@@ -35,6 +56,97 @@ void sched_queue_init(ktqueue_t *q);
  */
 int sched_queue_empty(ktqueue_t *q);
 
+/*
+ * Queue operations. These keep tq_size and each thread's kt_wchan in
+ * step with tq_list, so code outside the scheduler should use them
+ * rather than touching tq_list directly. Threads are linked through
+ * kt_qlink and come off a queue in the order they went on.
+ */
+
+/**
+ * Adds a thread to the tail of a queue.
+ *
+ * @param q the queue
+ * @param thr the thread, which must not be on any queue
+ */
+void ktqueue_enqueue(ktqueue_t *q, struct kthread *thr);
+
+/**
+ * Adds a thread to the head of a queue, so it is dequeued next.
+ *
+ * @param q the queue
+ * @param thr the thread, which must not be on any queue
+ */
+void ktqueue_enqueue_head(ktqueue_t *q, struct kthread *thr);
+
+/**
+ * Removes the thread at the head of a queue.
+ *
+ * @param q the queue
+ * @return the removed thread, or NULL if q is empty
+ */
+struct kthread *ktqueue_dequeue(ktqueue_t *q);
+
+/**
+ * Removes a specific thread from the queue it is on.
+ *
+ * @param q the queue
+ * @param thr the thread, which must be on q
+ */
+void ktqueue_remove(ktqueue_t *q, struct kthread *thr);
+
+/**
+ * Moves a thread from one queue to the tail of another without ending
+ * its wait, so nothing is counted in the statistics. For requeueing a
+ * thread that is still waiting for the same thing, such as a runnable
+ * thread changing run queue level.
+ *
+ * @param from the queue thr is on
+ * @param to the queue to move it to
+ * @param thr the thread
+ */
+void ktqueue_move(ktqueue_t *from, ktqueue_t *to, struct kthread *thr);
+
+/**
+ * Moves every thread on src onto the tail of dst, in order. The list
+ * itself is moved in one splice; only kt_wchan has to be updated per
+ * thread.
+ *
+ * @param dst the queue to move threads to
+ * @param src the queue to move threads from, empty afterwards
+ * @return the number of threads moved
+ */
+int ktqueue_splice(ktqueue_t *dst, ktqueue_t *src);
+
+/**
+ * Clears a queue's wait histogram, if __SCHED_STATS__ keeps one.
+ * sched_queue_init() should call this.
+ *
+ * @param q the queue
+ */
+void ktqueue_stats_init(ktqueue_t *q);
+
+/**
+ * Gives back the slot holding a queue's wait histogram, if
+ * __SCHED_STATS__ keeps one. Call this before the memory holding a
+ * queue that was ever waited on is freed or reused, otherwise its
+ * slot stays taken until another queue is initialized at the same
+ * address.
+ *
+ * @param q the queue, which must be empty
+ */
+void ktqueue_stats_fini(ktqueue_t *q);
+
+/**
+ * A dbg_infofunc_t showing a queue's size and wait histogram.
+ *
+ * @param arg a pointer to the queue
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t ktqueue_info(const void *arg, char *buf, size_t osize);
+
 /**
  * Causes the current thread to enter into an uncancellable sleep on
  * the given queue.
@@ -52,6 +164,27 @@ void sched_sleep_on(ktqueue_t *q);
  */
 int sched_cancellable_sleep_on(ktqueue_t *q);
 
+/**
+ * Like sched_sleep_on, but gives up after the given number of clock
+ * ticks. See MSECS_TO_TICKS in proc/timer.h.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the longest time to sleep, in ticks, at least 1
+ * @return -ETIMEDOUT if nobody woke us up in time and 0 otherwise
+ */
+int sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
+/**
+ * Like sched_cancellable_sleep_on, but gives up after the given
+ * number of clock ticks.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the longest time to sleep, in ticks, at least 1
+ * @return -EINTR if the thread was cancelled, -ETIMEDOUT if nobody
+ * woke us up in time and 0 otherwise
+ */
+int sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
 /**
  * Wakes a single thread from sleep if there are any waiting on the
  * queue.
@@ -62,7 +195,56 @@ int sched_cancellable_sleep_on(ktqueue_t *q);
 struct kthread *sched_wakeup_on(ktqueue_t *q);
 
 /**
- * Wake up all threads running on the queue.
+ * Wakes a single thread from sleep like sched_wakeup_on, but puts it
+ * at the front of the run queue so that it is the next thread
+ * sched_switch() picks. Meant for a thread that is about to give up
+ * the CPU to the one it wakes.
+ *
+ * Like sched_wakeup_on this is part of the scheduler proper, since
+ * only it knows which run queue sched_switch() takes threads from. It
+ * only changes who runs next, never whether the woken thread runs.
+ *
+ * @param q the q to wakeup a thread from
+ * @return NULL if q is empty and a thread waiting on the q otherwise
+ */
+struct kthread *sched_handoff_on(ktqueue_t *q);
+
+/**
+ * Wakes up to n threads from sleep on the queue, oldest first.
+ *
+ * @param q the queue to wake threads from
+ * @param n the largest number of threads to wake
+ * @return the number of threads woken
+ */
+int sched_wakeup_n(ktqueue_t *q, int n);
+
+/**
+ * Moves up to n sleeping threads from one queue to another without
+ * waking them ("wait morphing"). Waking threads that can only go
+ * straight back to sleep on another queue is wasted work; moving them
+ * there directly saves a context switch each. The threads stay
+ * cancellable if their sleep was.
+ *
+ * Only use this between plain sleep queues whose sleepers check their
+ * condition again in a loop once woken, as in
+ * "while (!cond) sched_sleep_on(q);". In particular:
+ *  - never morph onto a kmutex_t's km_waitq; kmutex_unlock() hands the
+ *    mutex to whoever it wakes there, and a morphed thread would not
+ *    know it held it, nor have kt_blockedon set for priority
+ *    inheritance;
+ *  - never morph a thread sleeping with a timeout; the timeout only
+ *    fires while the thread is still on the queue it went to sleep on.
+ *
+ * @param from the queue the threads are sleeping on
+ * @param to the queue to move them to
+ * @param n the largest number of threads to move, or -1 for all
+ * @return the number of threads moved
+ */
+int sched_morph_on(ktqueue_t *from, ktqueue_t *to, int n);
+
+/**
+ * Wake up all threads running on the queue. Should be done as one
+ * ktqueue_splice() onto the run queue rather than a thread at a time.
  *
  * @param q the queue to wake up threads from
  */
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "types.h"
+#include "config.h"
+
+#include "util/list.h"
+
+/* Converts a duration in milliseconds to clock ticks, rounding up */
+#define MSECS_TO_TICKS(ms)      (((ms) + TICK_MSECS - 1) / TICK_MSECS)
+
+typedef void (*ktimer_func_t)(void *arg);
+
+/*
+ * A one-shot timer. Timers hash into a wheel of TIMER_WHEEL_SLOTS
+ * slots by expiry tick, so adding and cancelling one is O(1) and each
+ * tick only looks at the timers in a single slot.
+ */
+typedef struct ktimer {
+        list_link_t     t_link;         /* link on a timer wheel slot */
+        uint32_t        t_expires;      /* tick at which the timer fires */
+        ktimer_func_t   t_func;         /* called from the clock interrupt */
+        void           *t_arg;          /* argument to t_func */
+} ktimer_t;
+
+/**
+ * Number of clock ticks since boot.
+ */
+extern uint32_t timer_now;
+
+void timer_init(void);
+
+/**
+ * Initializes a timer so that it can be added.
+ *
+ * @param t the timer
+ * @param func the function to call when the timer fires
+ * @param arg the argument to func
+ */
+void ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg);
+
+/**
+ * Arms a timer to fire after the given number of ticks. The timer
+ * must not already be pending.
+ *
+ * @param t the timer
+ * @param ticks how many ticks from now the timer should fire, at
+ * least 1
+ */
+void ktimer_add(ktimer_t *t, uint32_t ticks);
+
+/**
+ * Cancels a pending timer.
+ *
+ * @param t the timer
+ * @return 1 if the timer was pending and has been cancelled, 0 if it
+ * had already fired or was never added
+ */
+int ktimer_del(ktimer_t *t);
+
+/**
+ * Advances the clock by one tick and fires the timers that are due.
+ * Should be called from the clock interrupt handler every TICK_MSECS.
+ */
+void timer_tick(void);
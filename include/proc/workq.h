@@ -0,0 +1,55 @@
+#pragma once
+
+#include "util/list.h"
+
+/*
+ * A shared pool of worker threads for deferred work. Instead of
+ * creating a thread of its own, a subsystem fills in a work_t and
+ * queues it; one of the workers calls the function later, in thread
+ * context, so it may sleep.
+ *
+ * The pool starts with WORKQ_MIN_WORKERS threads. A worker that picks
+ * up an item while more are pending and nobody else is idle starts
+ * another worker, up to WORKQ_MAX_WORKERS, and a spare worker that has
+ * been idle for WORKQ_IDLE_TICKS exits. Without __MTP__ a process has
+ * only one thread, so the pool is fixed at one worker.
+ */
+
+typedef void (*work_func_t)(void *arg);
+
+typedef struct work {
+        list_link_t     w_link;         /* link on the pending list */
+        work_func_t     w_func;         /* called by a worker */
+        void           *w_arg;          /* argument to w_func */
+        int             w_queued;       /* 1 while on the pending list */
+} work_t;
+
+/**
+ * Initializes a work item so that it can be queued.
+ *
+ * @param w the work item
+ * @param func the function to run
+ * @param arg the argument to func
+ */
+void work_init(work_t *w, work_func_t func, void *arg);
+
+/**
+ * Queues a work item to be run by a worker thread. Items run in the
+ * order they were queued, but several may run at once on different
+ * workers. Safe to call from interrupt context. An item that is
+ * already pending is not queued twice; once a worker has taken it, it
+ * may be queued again, even by its own function.
+ *
+ * @param w the work item
+ * @return 1 if w was queued, 0 if it was already pending
+ */
+int workq_queue(work_t *w);
+
+/**
+ * Removes a work item that has not been taken by a worker yet. Does
+ * not wait for an item that is already running.
+ *
+ * @param w the work item
+ * @return 1 if w was pending and will not run, 0 otherwise
+ */
+int workq_cancel(work_t *w);
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Runs the thread and scheduler microbenchmarks and reports cycle
+ * counts under DBG_TEST. Must run in a thread of a process that has no
+ * other children, since it reaps every child it makes; initproc_run
+ * is the intended caller. Only built with __KBENCH__.
+ *
+ * @param arg1 unused
+ * @param arg2 unused
+ * @return NULL
+ */
+void *kbench_run(int arg1, void *arg2);
@@ -192,7 +192,9 @@ const char *dbg_color(uint64_t d_mode);
 void dbg_add_mode(const char *mode);
 void dbg_add_modes(const char *modes);
 #else
-#define dbg(mode, arg)
+#define dbg(mode, ...)
+#define dbgq(mode, ...)
+#define dbginfo(mode, func, data)
 #define dbg_active(mode) 0
 #define dbg_add_mode(mode)
 #define dbg_add_modes(modes)
@@ -17,4 +17,18 @@
 
 typedef void (*init_func_t)();
 
+/*
+ * Each init_depends(name) makes the init_func before it wait for the
+ * init_func called name. init_call_all runs every init_func in
+ * dependency order.
+ *
+ * With __INIT_PARALLEL__, init_call_all only runs the init_funcs that
+ * do not depend on sched_init, directly or through others. The boot
+ * code must then call init_call_parallel from the first thread, once
+ * the scheduler is running. That runs the rest, up to INIT_NWORKERS of
+ * them at once on worker threads under __MTP__.
+ */
 void init_call_all(void);
+#ifdef __INIT_PARALLEL__
+void init_call_parallel(void);
+#endif
@@ -28,6 +28,10 @@
  *   list_remove_head(list) removes the first element.
  *   list_remove_tail(list) removes the last element.
  *
+ * Splicing.
+ *   list_splice_tail(list, other) moves every element of other, in order,
+ *   onto the end of list in O(1), leaving other empty.
+ *
  * Item accessors.
  *   list_item(link, type, member)
  * Given a list_link_t* and the name of the type of structure which contains
@@ -101,6 +105,19 @@ typedef struct list {
 #define list_remove_tail(list)                                          \
         list_remove((list)->l_prev)
 
+#define list_splice_tail(list, other)                                   \
+        do {                                                            \
+                list_t *__dst = (list);                                 \
+                list_t *__src = (other);                                \
+                if (!list_empty(__src)) {                               \
+                        __src->l_next->l_prev = __dst->l_prev;          \
+                        __dst->l_prev->l_next = __src->l_next;          \
+                        __src->l_prev->l_next = __dst;                  \
+                        __dst->l_prev = __src->l_prev;                  \
+                        list_init(__src);                               \
+                }                                                       \
+        } while(0)
+
 #define list_item(link, type, member)                                   \
         (type*)((char*)(link) - offsetof(type, member))
 
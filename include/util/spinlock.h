@@ -0,0 +1,34 @@
+#pragma once
+
+#include "types.h"
+
+/*
+ * A test-and-set spin lock for the short critical sections that have
+ * to be safe between CPUs, such as the per-CPU run queues. Never sleep
+ * while holding one. On a uniprocessor kernel they compile down to
+ * nothing.
+ */
+typedef struct spinlock {
+        volatile uint32_t s_locked;
+} spinlock_t;
+
+#ifdef __SMP__
+#define spinlock_init(lock)                                             \
+        do {                                                            \
+                (lock)->s_locked = 0;                                   \
+        } while (0)
+
+#define spinlock_lock(lock)                                             \
+        do {                                                            \
+                while (__sync_lock_test_and_set(&(lock)->s_locked, 1))  \
+                        while ((lock)->s_locked)                        \
+                                __asm__ volatile ("pause");             \
+        } while (0)
+
+#define spinlock_unlock(lock)                                           \
+        __sync_lock_release(&(lock)->s_locked)
+#else
+#define spinlock_init(lock)     do { (void)(lock); } while (0)
+#define spinlock_lock(lock)     do { (void)(lock); } while (0)
+#define spinlock_unlock(lock)   do { (void)(lock); } while (0)
+#endif
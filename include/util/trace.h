@@ -0,0 +1,82 @@
+#pragma once
+
+#include "types.h"
+
+/*
+ * Binary tracing. dbgt() is a dbg() for hot paths: instead of
+ * formatting and printing the message it copies the call site and up to
+ * TRACE_NARGS 32-bit arguments into a per-CPU ring buffer, and the
+ * formatting happens later, when someone reads the buffer with
+ * trace_info. Old records are overwritten once a ring fills up.
+ *
+ * Since formatting is deferred, arguments must stay meaningful after
+ * the call returns: integers and pointers used as identifiers are fine,
+ * strings that may be freed are not. Each argument is cast to a
+ * uint32_t, so format with %d, %u, %x or %p only.
+ *
+ * Modes are enabled in trace_modes, separately from dbg_modes, so
+ * tracing can be left on for modes that would be far too slow to print.
+ */
+
+#define TRACE_NARGS 4
+
+typedef struct trace_site {
+        uint64_t        ts_mode;
+        const char     *ts_file;
+        const char     *ts_func;
+        int             ts_line;
+        const char     *ts_fmt;
+} trace_site_t;
+
+typedef struct trace_rec {
+        uint32_t            tr_seq;     /* ring index + 1, 0 while being written */
+        const trace_site_t *tr_site;
+        uint64_t            tr_stamp;   /* cycle counter */
+        uint32_t            tr_args[TRACE_NARGS];
+} trace_rec_t;
+
+extern uint64_t trace_modes;
+
+#define trace_active(mode) (trace_modes & (mode))
+
+#define dbgt(mode, fmt, ...)                                            \
+        do {                                                            \
+                if (trace_active(mode)) {                               \
+                        static const trace_site_t __site = {           \
+                                (mode), __FILE__, __func__, __LINE__, fmt \
+                        };                                              \
+                        uint32_t __args[TRACE_NARGS] = { __VA_ARGS__ }; \
+                        trace_record(&__site, __args);                  \
+                }                                                       \
+        } while(0)
+
+static inline uint64_t
+trace_cycles(void)
+{
+        uint32_t lo, hi;
+
+        __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+        return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * Appends a record to the current CPU's ring. Safe to call from
+ * interrupt context and never blocks. Used by dbgt().
+ *
+ * @param site the static description of the call site
+ * @param args TRACE_NARGS arguments for the site's format string
+ */
+void trace_record(const trace_site_t *site, const uint32_t *args);
+
+/**
+ * A dbg_infofunc_t which formats the records still in one CPU's ring,
+ * oldest first.
+ *
+ * @param arg the CPU id, cast to a pointer
+ */
+size_t trace_info(const void *arg, char *buf, size_t osize);
+
+/**
+ * Prints every CPU's ring with dbg_printinfo.
+ */
+void trace_dump(void);
@@ -0,0 +1,260 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/string.h"
+#include "util/trace.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+/*
+ * The .init section is a run of entries, each a 32-bit word followed
+ * by a NUL-terminated name. A non-zero word is an init_func's address;
+ * a zero word is an init_depends naming something the preceding
+ * init_func needs first. We turn that into a DAG and run it in
+ * topological order.
+ *
+ * With __INIT_PARALLEL__, functions that depend on sched_init are held
+ * back for init_call_parallel, since they may create threads and
+ * sleep. There, an init_func whose dependencies are all done is put on
+ * init_readyq and any idle worker may take it, so independent ones
+ * that sleep (on the disk, say) overlap instead of adding up.
+ */
+
+#define INIT_MAX_FUNCS          128
+#define INIT_MAX_EDGES          256
+#define INIT_PARALLEL_AFTER     "sched_init"
+
+extern uintptr_t kernel_start_init;
+extern uintptr_t kernel_end_init;
+
+typedef struct init_entry {
+        init_func_t     ie_func;
+        const char     *ie_name;
+        int             ie_late;        /* held back for init_call_parallel */
+        int             ie_npending;    /* dependencies not yet run */
+        uint64_t        ie_cycles;      /* how long ie_func took */
+} init_entry_t;
+
+typedef struct init_edge {
+        int             ig_dep;         /* must run before... */
+        int             ig_func;        /* ...this one */
+} init_edge_t;
+
+static init_entry_t init_entries[INIT_MAX_FUNCS];
+static int init_nentries = 0;
+static init_edge_t init_edges[INIT_MAX_EDGES];
+static int init_nedges = 0;
+static int init_order[INIT_MAX_FUNCS]; /* a topological order */
+
+static int
+init_lookup(const char *name)
+{
+        int i;
+
+        for (i = 0; i < init_nentries; ++i) {
+                if (0 == strcmp(init_entries[i].ie_name, name))
+                        return i;
+        }
+        panic("init_depends on unknown init_func %s\n", name);
+        return -1;
+}
+
+static void
+init_parse(void)
+{
+        const char *cur = (const char *)&kernel_start_init;
+        const char *end = (const char *)&kernel_end_init;
+        const char *depnames[INIT_MAX_EDGES];
+        uint32_t addr;
+        int i;
+
+        while (cur < end) {
+                addr = *(const uint32_t *)cur;
+                cur += sizeof(uint32_t);
+                if (0 != addr) {
+                        KASSERT(init_nentries < INIT_MAX_FUNCS);
+                        init_entries[init_nentries].ie_func = (init_func_t)addr;
+                        init_entries[init_nentries].ie_name = cur;
+                        init_nentries++;
+                } else {
+                        KASSERT(init_nentries > 0 && "init_depends before any init_func");
+                        KASSERT(init_nedges < INIT_MAX_EDGES);
+                        depnames[init_nedges] = cur;
+                        init_edges[init_nedges].ig_func = init_nentries - 1;
+                        init_nedges++;
+                }
+                cur += strlen(cur) + 1;
+        }
+
+        /* Names can only be resolved once every init_func has been seen */
+        for (i = 0; i < init_nedges; ++i)
+                init_edges[i].ig_dep = init_lookup(depnames[i]);
+}
+
+/* Kahn's algorithm, which also finds which entries are late */
+static void
+init_sort(void)
+{
+        int head = 0, tail = 0;
+        int i, e, late = init_lookup(INIT_PARALLEL_AFTER);
+
+        for (i = 0; i < init_nentries; ++i)
+                init_entries[i].ie_npending = 0;
+        for (e = 0; e < init_nedges; ++e)
+                init_entries[init_edges[e].ig_func].ie_npending++;
+        for (i = 0; i < init_nentries; ++i) {
+                if (0 == init_entries[i].ie_npending)
+                        init_order[tail++] = i;
+        }
+
+        while (head < tail) {
+                i = init_order[head++];
+                for (e = 0; e < init_nedges; ++e) {
+                        if (init_edges[e].ig_dep != i)
+                                continue;
+                        if (i == late || init_entries[i].ie_late)
+                                init_entries[init_edges[e].ig_func].ie_late = 1;
+                        if (0 == --init_entries[init_edges[e].ig_func].ie_npending)
+                                init_order[tail++] = init_edges[e].ig_func;
+                }
+        }
+        if (tail != init_nentries)
+                panic("init_depends has a cycle among %d init_funcs\n",
+                      init_nentries - tail);
+}
+
+static void
+init_run(init_entry_t *ie)
+{
+        uint64_t start = trace_cycles();
+
+        ie->ie_func();
+        ie->ie_cycles = trace_cycles() - start;
+        dbg(DBG_INIT, "%s: %u kcycles\n", ie->ie_name, (uint32_t)(ie->ie_cycles >> 10));
+}
+
+void
+init_call_all(void)
+{
+        init_entry_t *ie;
+        int i;
+#ifdef __INIT_PARALLEL__
+        int e;
+#endif
+
+        init_parse();
+        init_sort();
+
+        for (i = 0; i < init_nentries; ++i) {
+                ie = &init_entries[init_order[i]];
+#ifdef __INIT_PARALLEL__
+                if (ie->ie_late)
+                        continue;
+#endif
+                init_run(ie);
+        }
+
+#ifdef __INIT_PARALLEL__
+        /* What late entries still wait for, now the early ones are done */
+        for (e = 0; e < init_nedges; ++e) {
+                if (init_entries[init_edges[e].ig_dep].ie_late)
+                        init_entries[init_edges[e].ig_func].ie_npending++;
+        }
+#endif
+}
+
+#ifdef __INIT_PARALLEL__
+#ifdef __MTP__
+static ktqueue_t init_readyq;   /* idle workers */
+static ktqueue_t init_doneq;    /* init_call_parallel waits here */
+static int init_ready[INIT_MAX_FUNCS]; /* runnable entries, a FIFO */
+static int init_nready_head = 0;
+static int init_nready_tail = 0;
+static int init_nleft = 0;      /* late entries not finished yet */
+
+static void
+init_make_ready(int i)
+{
+        init_ready[init_nready_tail++] = i;
+        sched_wakeup_on(&init_readyq);
+}
+
+/* Relies on the kernel being non-preemptive, like the rest of sched */
+static void *
+init_worker(int arg1, void *arg2)
+{
+        int i, e;
+
+        for (;;) {
+                while (init_nready_head == init_nready_tail && init_nleft > 0)
+                        sched_sleep_on(&init_readyq);
+                if (0 == init_nleft)
+                        break;
+
+                i = init_ready[init_nready_head++];
+                init_run(&init_entries[i]);
+
+                for (e = 0; e < init_nedges; ++e) {
+                        if (init_edges[e].ig_dep == i &&
+                            0 == --init_entries[init_edges[e].ig_func].ie_npending)
+                                init_make_ready(init_edges[e].ig_func);
+                }
+                if (0 == --init_nleft) {
+                        sched_broadcast_on(&init_readyq);
+                        sched_wakeup_on(&init_doneq);
+                }
+        }
+        return NULL;
+}
+
+void
+init_call_parallel(void)
+{
+        kthread_t *workers[INIT_NWORKERS];
+        uint64_t start __attribute__((unused)) = trace_cycles(); /* dbg only */
+        int i, n;
+
+        sched_queue_init(&init_readyq);
+        sched_queue_init(&init_doneq);
+
+        for (i = 0; i < init_nentries; ++i) {
+                if (!init_entries[i].ie_late)
+                        continue;
+                init_nleft++;
+                if (0 == init_entries[i].ie_npending)
+                        init_ready[init_nready_tail++] = i;
+        }
+        if (0 == init_nleft)
+                return;
+
+        for (n = 0; n < INIT_NWORKERS && n < init_nleft; ++n) {
+                workers[n] = kthread_create(curproc, init_worker, 0, NULL);
+                KASSERT(NULL != workers[n]);
+                sched_make_runnable(workers[n]);
+        }
+
+        while (init_nleft > 0)
+                sched_sleep_on(&init_doneq);
+        for (i = 0; i < n; ++i)
+                kthread_join(workers[i], NULL);
+
+        dbg(DBG_INIT, "parallel init: %u kcycles\n",
+            (uint32_t)((trace_cycles() - start) >> 10));
+}
+#else
+void
+init_call_parallel(void)
+{
+        int i;
+
+        for (i = 0; i < init_nentries; ++i) {
+                if (init_entries[init_order[i]].ie_late)
+                        init_run(&init_entries[init_order[i]]);
+        }
+}
+#endif
+#endif /* __INIT_PARALLEL__ */
@@ -0,0 +1,284 @@
+#ifdef __KBENCH__
+
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/trace.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "test/kbench.h"
+
+/*
+ * Microbenchmarks for thread lifecycle and scheduler primitives. Each
+ * one repeats an operation KBENCH_ITERS times and reports the mean and
+ * best cycle count per operation, so allocator and scheduler changes
+ * can be compared against a baseline run. Numbers assume the kernel is
+ * otherwise idle.
+ */
+
+#define KBENCH_ITERS            256
+#define KBENCH_MAX_WAITERS      64
+
+typedef struct kbench_stat {
+        const char     *kb_name;
+        uint64_t        kb_total;
+        uint64_t        kb_min;
+        uint32_t        kb_n;
+} kbench_stat_t;
+
+static ktqueue_t kbench_pingq;
+static ktqueue_t kbench_pongq;
+static ktqueue_t kbench_waitq;
+
+static void
+kbench_stat_init(kbench_stat_t *ks, const char *name)
+{
+        ks->kb_name = name;
+        ks->kb_total = 0;
+        ks->kb_min = ~0ULL;
+        ks->kb_n = 0;
+}
+
+static void
+kbench_stat_add(kbench_stat_t *ks, uint64_t start, uint64_t end)
+{
+        uint64_t cycles = end - start;
+
+        ks->kb_total += cycles;
+        if (cycles < ks->kb_min)
+                ks->kb_min = cycles;
+        ks->kb_n++;
+}
+
+static void
+kbench_report(kbench_stat_t *ks)
+{
+        KASSERT(ks->kb_n > 0);
+        dbg(DBG_TEST, "%-28s %10u cycles/op (best %u, %u runs)\n", ks->kb_name,
+            (uint32_t)(ks->kb_total / ks->kb_n), (uint32_t)ks->kb_min, ks->kb_n);
+}
+
+static void
+kbench_yield(void)
+{
+        sched_make_runnable(curthr);
+        sched_switch();
+}
+
+/* Starts func in a new child process and returns its pid */
+static pid_t
+kbench_spawn(kthread_func_t func, int arg1, kthread_t **thrp)
+{
+        proc_t *p = proc_create("kbench");
+        kthread_t *thr;
+
+        KASSERT(NULL != p);
+        thr = kthread_create(p, func, arg1, NULL);
+        KASSERT(NULL != thr);
+        sched_make_runnable(thr);
+        if (NULL != thrp)
+                *thrp = thr;
+        return p->p_pid;
+}
+
+static void
+kbench_reap(pid_t pid)
+{
+        int status;
+
+        /* Not a KASSERT, the wait has to happen in NDEBUG builds too */
+        if (do_waitpid(pid, 0, &status) != pid)
+                panic("kbench could not reap child %d\n", pid);
+}
+
+static void *
+kbench_noop(int arg1, void *arg2)
+{
+        return NULL;
+}
+
+static void *
+kbench_sleeper(int arg1, void *arg2)
+{
+        if (arg1)
+                sched_cancellable_sleep_on(&kbench_waitq);
+        else
+                sched_sleep_on(&kbench_waitq);
+        return NULL;
+}
+
+static void *
+kbench_pong(int arg1, void *arg2)
+{
+        int i;
+
+        for (i = 0; i < arg1; ++i) {
+                sched_sleep_on(&kbench_pongq);
+                sched_wakeup_on(&kbench_pingq);
+        }
+        return NULL;
+}
+
+/* kthread_create and kthread_destroy of a thread that never runs */
+static void
+kbench_create_destroy(void)
+{
+        kbench_stat_t ks;
+        kthread_t *thr;
+        uint64_t start;
+        int i;
+
+        kbench_stat_init(&ks, "kthread_create+destroy");
+        for (i = 0; i < KBENCH_ITERS; ++i) {
+                start = trace_cycles();
+                thr = kthread_create(curproc, kbench_noop, 0, NULL);
+                KASSERT(NULL != thr);
+                kthread_destroy(thr);
+                kbench_stat_add(&ks, start, trace_cycles());
+        }
+        kbench_report(&ks);
+
+        kbench_stat_init(&ks, "kthread_clone+destroy");
+        for (i = 0; i < KBENCH_ITERS; ++i) {
+                start = trace_cycles();
+                thr = kthread_clone(curthr);
+                KASSERT(NULL != thr);
+                kthread_destroy(thr);
+                kbench_stat_add(&ks, start, trace_cycles());
+        }
+        kbench_report(&ks);
+}
+
+/* One round trip is a wakeup and a switch in each direction */
+static void
+kbench_pingpong(void)
+{
+        kbench_stat_t ks;
+        uint64_t start;
+        pid_t pid;
+        int i;
+
+        kbench_stat_init(&ks, "sleep/wakeup round trip");
+        pid = kbench_spawn(kbench_pong, KBENCH_ITERS, NULL);
+        for (i = 0; i < KBENCH_ITERS; ++i) {
+                while (sched_queue_empty(&kbench_pongq))
+                        kbench_yield();
+
+                start = trace_cycles();
+                sched_wakeup_on(&kbench_pongq);
+                sched_sleep_on(&kbench_pingq);
+                kbench_stat_add(&ks, start, trace_cycles());
+        }
+        kbench_reap(pid);
+        kbench_report(&ks);
+}
+
+/* The cost of sched_broadcast_on itself as the number of waiters grows */
+static void
+kbench_broadcast(void)
+{
+        static const char *names[] = {
+                "broadcast, 1 waiter", "broadcast, 4 waiters",
+                "broadcast, 16 waiters", "broadcast, 64 waiters"
+        };
+        pid_t pids[KBENCH_MAX_WAITERS];
+        kbench_stat_t ks;
+        uint64_t start;
+        int nwaiters, round, i, n;
+
+        for (n = 0, nwaiters = 1; nwaiters <= KBENCH_MAX_WAITERS; nwaiters *= 4, ++n) {
+                kbench_stat_init(&ks, names[n]);
+                for (round = 0; round < KBENCH_ITERS / nwaiters; ++round) {
+                        for (i = 0; i < nwaiters; ++i)
+                                pids[i] = kbench_spawn(kbench_sleeper, 0, NULL);
+                        while (kbench_waitq.tq_size < nwaiters)
+                                kbench_yield();
+
+                        start = trace_cycles();
+                        sched_broadcast_on(&kbench_waitq);
+                        kbench_stat_add(&ks, start, trace_cycles());
+
+                        for (i = 0; i < nwaiters; ++i)
+                                kbench_reap(pids[i]);
+                }
+                kbench_report(&ks);
+        }
+}
+
+/* From kthread_cancel of a sleeping thread until its process is reaped */
+static void
+kbench_cancel(void)
+{
+        kbench_stat_t ks;
+        kthread_t *thr;
+        uint64_t start;
+        pid_t pid;
+        int i;
+
+        kbench_stat_init(&ks, "kthread_cancel+reap");
+        for (i = 0; i < KBENCH_ITERS; ++i) {
+                pid = kbench_spawn(kbench_sleeper, 1, &thr);
+                while (sched_queue_empty(&kbench_waitq))
+                        kbench_yield();
+
+                start = trace_cycles();
+                kthread_cancel(thr, NULL);
+                kbench_reap(pid);
+                kbench_stat_add(&ks, start, trace_cycles());
+        }
+        kbench_report(&ks);
+}
+
+/*
+ * Process creation up to its reaping. do_fork needs a user trapframe,
+ * so this uses proc_create and kthread_create, which is the part of
+ * fork that the thread and scheduler code is responsible for.
+ */
+static void
+kbench_spawn_wait(void)
+{
+        kbench_stat_t ks;
+        uint64_t start;
+        int i;
+
+        kbench_stat_init(&ks, "process create+exit+wait");
+        for (i = 0; i < KBENCH_ITERS; ++i) {
+                start = trace_cycles();
+                kbench_reap(kbench_spawn(kbench_noop, 0, NULL));
+                kbench_stat_add(&ks, start, trace_cycles());
+        }
+        kbench_report(&ks);
+}
+
+void *
+kbench_run(int arg1, void *arg2)
+{
+        KASSERT(list_empty(&curproc->p_children));
+
+        dbg(DBG_TEST, "running microbenchmarks, %d iterations each\n", KBENCH_ITERS);
+        kbench_create_destroy();
+        kbench_pingpong();
+        kbench_broadcast();
+        kbench_cancel();
+        kbench_spawn_wait();
+        dbg(DBG_TEST, "microbenchmarks done\n");
+        return NULL;
+}
+
+static __attribute__((unused)) void
+kbench_init()
+{
+        sched_queue_init(&kbench_pingq);
+        sched_queue_init(&kbench_pongq);
+        sched_queue_init(&kbench_waitq);
+}
+init_func(kbench_init);
+init_depends(sched_init);
+
+#endif /* __KBENCH__ */
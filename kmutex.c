@@ -0,0 +1,259 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/trace.h"
+#include "util/list.h"
+
+#include "proc/cpu.h"
+#include "proc/kmutex.h"
+#include "proc/kthread.h"
+#include "proc/runq.h"
+#include "proc/sched.h"
+
+void
+kmutex_init(kmutex_t *mtx)
+{
+        mtx->km_holder = NULL;
+        sched_queue_init(&mtx->km_waitq);
+        list_link_init(&mtx->km_link);
+        spinlock_init(&mtx->km_lock);
+}
+
+int
+kmutex_trylock(kmutex_t *mtx)
+{
+        KASSERT(curthr && (curthr != mtx->km_holder));
+
+        if (!__sync_bool_compare_and_swap(&mtx->km_holder, NULL, curthr))
+                return 0;
+
+        list_insert_tail(&curthr->kt_mutexes, &mtx->km_link);
+        return 1;
+}
+
+/*
+ * Priority inheritance. A thread holding mutexes runs at the most
+ * urgent priority of anybody waiting on any of them, so a low priority
+ * holder cannot keep an urgent waiter stuck behind unrelated medium
+ * priority work.
+ */
+
+/* Sets thr's inherited priority and moves it to its new effective one */
+static void
+kmutex_inherit(kthread_t *thr, int prio)
+{
+        cpu_t *cpu = &cpus[thr->kt_cpu];
+
+        thr->kt_inheritprio = prio;
+        spinlock_lock(&cpu->cpu_runqlock);
+        runq_setprio(&cpu->cpu_runq, thr, KT_EFFECTIVE_PRIO(thr));
+        spinlock_unlock(&cpu->cpu_runqlock);
+}
+
+/* The most urgent priority among the waiters on mtx, under km_lock */
+static int
+kmutex_queue_prio(kmutex_t *mtx)
+{
+        int prio = KT_PRIO_NONE;
+        kthread_t *waiter;
+
+        list_iterate_begin(&mtx->km_waitq.tq_list, waiter, kthread_t, kt_qlink) {
+                if (waiter->kt_prio < prio)
+                        prio = waiter->kt_prio;
+        } list_iterate_end();
+        return prio;
+}
+
+/* The most urgent priority among the waiters on mutexes thr holds */
+static int
+kmutex_waiters_prio(kthread_t *thr)
+{
+        int prio = KT_PRIO_NONE, qprio;
+        kmutex_t *mtx;
+
+        list_iterate_begin(&thr->kt_mutexes, mtx, kmutex_t, km_link) {
+                spinlock_lock(&mtx->km_lock);
+                qprio = kmutex_queue_prio(mtx);
+                spinlock_unlock(&mtx->km_lock);
+                if (qprio < prio)
+                        prio = qprio;
+        } list_iterate_end();
+        return prio;
+}
+
+/*
+ * Boosts the holder of mtx to prio, and if that holder is itself
+ * blocked on a mutex, the holder of that one too, and so on. The chain
+ * is cut at KMUTEX_PI_DEPTH so a deadlock cycle cannot loop forever.
+ */
+static void
+kmutex_boost(kmutex_t *mtx, int prio)
+{
+        kthread_t *holder;
+        int depth;
+
+        for (depth = 0; depth < KMUTEX_PI_DEPTH && NULL != mtx; ++depth) {
+                holder = mtx->km_holder;
+                if (NULL == holder || holder->kt_inheritprio <= prio)
+                        break;
+
+                dbgt(DBG_SCHED, "thread %p inherits priority %d through mutex %p\n",
+                     (uint32_t)holder, prio, (uint32_t)mtx);
+                /*
+                 * Aging may already have lifted kt_prio past prio. Leave
+                 * it there, but still record the inheritance so that the
+                 * reset to KT_EFFECTIVE_PRIO when it next runs keeps it.
+                 */
+                if (holder->kt_prio <= prio)
+                        holder->kt_inheritprio = prio;
+                else
+                        kmutex_inherit(holder, prio);
+                mtx = holder->kt_blockedon;
+        }
+}
+
+#ifdef __SMP__
+/*
+ * Spinning only pays off while the holder is actually running, since
+ * only then is it going to let go of the mutex soon.
+ */
+static int
+kmutex_spin(kmutex_t *mtx)
+{
+        kthread_t *holder;
+        int i;
+
+        for (i = 0; i < KMUTEX_SPIN_LIMIT; ++i) {
+                holder = mtx->km_holder;
+                if (NULL == holder)
+                        return kmutex_trylock(mtx);
+                if (cpus[holder->kt_cpu].cpu_thr != holder)
+                        return 0;
+                __asm__ volatile ("pause");
+        }
+        return 0;
+}
+#endif
+
+/*
+ * Goes to sleep on km_waitq and drops km_lock, which the caller holds.
+ * On SMP we have to be on the queue before the lock is dropped, or an
+ * unlock on another CPU could find the queue empty and leave us asleep
+ * on a free mutex, so this does by hand what sched_sleep_on() does.
+ * On a uniprocessor nothing can run in between and the lock is a no-op.
+ */
+static int
+kmutex_sleep(kmutex_t *mtx, int cancellable)
+{
+#ifdef __SMP__
+        if (cancellable && curthr->kt_cancelled) {
+                spinlock_unlock(&mtx->km_lock);
+                return -EINTR;
+        }
+        curthr->kt_state = cancellable ? KT_SLEEP_CANCELLABLE : KT_SLEEP;
+        ktqueue_enqueue(&mtx->km_waitq, curthr);
+        spinlock_unlock(&mtx->km_lock);
+
+        sched_switch();
+        return (cancellable && curthr->kt_cancelled) ? -EINTR : 0;
+#else
+        spinlock_unlock(&mtx->km_lock);
+        if (cancellable)
+                return sched_cancellable_sleep_on(&mtx->km_waitq);
+        sched_sleep_on(&mtx->km_waitq);
+        return 0;
+#endif
+}
+
+/*
+ * The slow path of kmutex_lock. kmutex_unlock hands the mutex over
+ * without ever making it available, so once we are woken up (and not
+ * cancelled) we already hold it.
+ *
+ * The last trylock and getting on km_waitq both happen under km_lock,
+ * which kmutex_unlock also takes to look for a waiter, so an unlock
+ * cannot slip in between them.
+ */
+static int
+kmutex_wait(kmutex_t *mtx, int cancellable)
+{
+        int ret;
+
+        KASSERT(curthr && (curthr != mtx->km_holder));
+
+        if (kmutex_trylock(mtx))
+                return 0;
+#ifdef __SMP__
+        if (kmutex_spin(mtx))
+                return 0;
+#endif
+
+        spinlock_lock(&mtx->km_lock);
+        if (kmutex_trylock(mtx)) {
+                spinlock_unlock(&mtx->km_lock);
+                return 0;
+        }
+        curthr->kt_blockedon = mtx;
+        kmutex_boost(mtx, curthr->kt_prio);
+        ret = kmutex_sleep(mtx, cancellable);
+        curthr->kt_blockedon = NULL;
+
+        if (curthr == mtx->km_holder)
+                return 0;
+
+        KASSERT(-EINTR == ret);
+        return ret;
+}
+
+void
+kmutex_lock(kmutex_t *mtx)
+{
+        kmutex_wait(mtx, 0);
+}
+
+int
+kmutex_lock_cancellable(kmutex_t *mtx)
+{
+        return kmutex_wait(mtx, 1);
+}
+
+void
+kmutex_unlock(kmutex_t *mtx)
+{
+        kthread_t *waiter;
+        int prio;
+
+        KASSERT(curthr && (curthr == mtx->km_holder));
+
+        list_remove(&mtx->km_link);
+
+        /*
+         * Set the new holder, and give it the priority of the waiters
+         * still queued behind it, before it can run anywhere. It keeps
+         * whatever it inherited through its other mutexes.
+         */
+        spinlock_lock(&mtx->km_lock);
+        waiter = ktqueue_dequeue(&mtx->km_waitq);
+        mtx->km_holder = waiter;
+        if (NULL != waiter) {
+                KASSERT(KT_SLEEP == waiter->kt_state ||
+                        KT_SLEEP_CANCELLABLE == waiter->kt_state);
+                list_insert_tail(&waiter->kt_mutexes, &mtx->km_link);
+                waiter->kt_blockedon = NULL;
+                if ((prio = kmutex_queue_prio(mtx)) < waiter->kt_inheritprio)
+                        kmutex_inherit(waiter, prio);
+                sched_make_runnable(waiter);
+        }
+        spinlock_unlock(&mtx->km_lock);
+
+        /*
+         * Drop whatever we inherited through mtx. A cancelled waiter's
+         * boost lingers until here as well.
+         */
+        kmutex_inherit(curthr, kmutex_waiters_prio(curthr));
+
+        KASSERT(curthr != mtx->km_holder);
+}
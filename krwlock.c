@@ -0,0 +1,59 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+
+#include "proc/krwlock.h"
+#include "proc/kthread.h"
+#include "proc/sched.h"
+
+void
+krwlock_init(krwlock_t *rw)
+{
+        rw->rw_readers = 0;
+        rw->rw_writer = NULL;
+        rw->rw_wwaiting = 0;
+        sched_queue_init(&rw->rw_rwaitq);
+        sched_queue_init(&rw->rw_wwaitq);
+}
+
+void
+krwlock_read_lock(krwlock_t *rw)
+{
+        KASSERT(curthr && (curthr != rw->rw_writer));
+
+        while (NULL != rw->rw_writer || rw->rw_wwaiting > 0)
+                sched_sleep_on(&rw->rw_rwaitq);
+        rw->rw_readers++;
+}
+
+void
+krwlock_read_unlock(krwlock_t *rw)
+{
+        KASSERT(rw->rw_readers > 0 && NULL == rw->rw_writer);
+
+        if (0 == --rw->rw_readers)
+                sched_wakeup_on(&rw->rw_wwaitq);
+}
+
+void
+krwlock_write_lock(krwlock_t *rw)
+{
+        KASSERT(curthr && (curthr != rw->rw_writer));
+
+        rw->rw_wwaiting++;
+        while (NULL != rw->rw_writer || rw->rw_readers > 0)
+                sched_sleep_on(&rw->rw_wwaitq);
+        rw->rw_wwaiting--;
+        rw->rw_writer = curthr;
+}
+
+void
+krwlock_write_unlock(krwlock_t *rw)
+{
+        KASSERT(curthr && (curthr == rw->rw_writer));
+
+        rw->rw_writer = NULL;
+        if (NULL == sched_wakeup_on(&rw->rw_wwaitq))
+                sched_broadcast_on(&rw->rw_rwaitq);
+}
@@ -4,20 +4,35 @@
 
 #include "errno.h"
 
+#include "main/interrupt.h"
+
 #include "util/init.h"
 #include "util/debug.h"
+#include "util/trace.h"
 #include "util/list.h"
+#include "util/spinlock.h"
 #include "util/string.h"
+#include "util/printf.h"
 
+#include "proc/cpu.h"
+#include "proc/fpu.h"
+#include "proc/kmutex.h"
 #include "proc/kthread.h"
 #include "proc/proc.h"
+#include "proc/runq.h"
 #include "proc/sched.h"
 
+#include "mm/magazine.h"
 #include "mm/slab.h"
 #include "mm/page.h"
 
+#if !defined(__SMP__) && !defined(__KSTACK_TCB__)
 kthread_t *curthr; /* global */
+#endif
+#ifndef __KSTACK_TCB__
 static slab_allocator_t *kthread_allocator = NULL;
+static slab_magazine_t kthread_magazine;
+#endif
 
 #ifdef __MTP__
 /* Stuff for the reaper daemon, which cleans up dead detached threads */
@@ -25,31 +40,97 @@ static proc_t *reapd = NULL;
 static kthread_t *reapd_thr = NULL;
 static ktqueue_t reapd_waitq;
 static list_t kthread_reapd_deadlist; /* Threads to be cleaned */
+static int reapd_ndead = 0; /* Threads on kthread_reapd_deadlist */
+static int reapd_exiting = 0;
 
 static void *kthread_reapd_run(int arg1, void *arg2);
+static void kthread_reapd_enqueue(kthread_t *kthr);
 #endif
 
 void
 kthread_init()
 {
+#ifdef __KSTACK_TCB__
+        KASSERT(sizeof(kthread_t) <= PAGE_SIZE);
+        KASSERT(0 == (KSTACK_BLOCK_SIZE & (KSTACK_BLOCK_SIZE - 1)));
+#else
         kthread_allocator = slab_allocator_create("kthread", sizeof(kthread_t));
         KASSERT(NULL != kthread_allocator);
+        slab_magazine_init(&kthread_magazine, kthread_allocator);
+#endif
 }
 
+/*
+ * kthread_self() has to know the block size from the stack pointer
+ * alone, so with __KSTACK_TCB__ every class gets a default-sized block.
+ */
+#ifdef __KSTACK_TCB__
+#define KSTACK_SIZE(sclass)   DEFAULT_STACK_SIZE
+#define KSTACK_NPAGES(sclass) (KSTACK_BLOCK_SIZE >> PAGE_SHIFT)
+#else
+static const size_t kstack_sizes[KT_STACK_NCLASSES] = {
+        [KT_STACK_SMALL]   = SMALL_STACK_SIZE,
+        [KT_STACK_MEDIUM]  = MEDIUM_STACK_SIZE,
+        [KT_STACK_DEFAULT] = DEFAULT_STACK_SIZE
+};
+#define KSTACK_SIZE(sclass)   (kstack_sizes[(sclass)])
+/* extra page for "magic" data */
+#define KSTACK_NPAGES(sclass) (1 + (KSTACK_SIZE(sclass) >> PAGE_SHIFT))
+#endif
+
+/*
+ * The "magic" page is the lowest page of the block and the stack sits
+ * right above it. The page is filled with KSTACK_GUARD_MAGIC when the
+ * block first comes from the page allocator, so a stack that grows past
+ * its bottom overwrites the pattern where kthread_stack_intact() can
+ * see it, instead of silently scribbling on a neighbouring block.
+ */
+#define KSTACK_GUARD_MAGIC    0xfeedface
+#define KSTACK_GUARD_CHECK    16        /* guard words kthread_stack_intact() looks at */
+#define KSTACK_BASE(kstack)   ((char *)(kstack) + PAGE_SIZE)
+
+/*
+ * Caches of free kernel stacks in front of the page allocator, one per
+ * stack size class. Stacks handed to free_stack() are parked here until
+ * their cache holds KSTACK_CACHE_HIWAT of them, and alloc_stack() takes
+ * from it before going to page_alloc_n(). Each CPU has its own set,
+ * so the fast path never contends with other CPUs.
+ */
+static struct kstack_cache {
+        int     ksc_count;
+        char   *ksc_stacks[KSTACK_CACHE_HIWAT];
+} kstack_cache[NCPUS][KT_STACK_NCLASSES];
+
+#define KSTACK_CACHE(sclass) (&kstack_cache[curcpu()->cpu_id][(sclass)])
+
 /**
  * Allocates a new kernel stack.
  *
+ * @param sclass the size class of the stack
  * @return a newly allocated stack, or NULL if there is not enough
  * memory available
  */
 static char *
-alloc_stack(void)
+alloc_stack(kthread_stack_class_t sclass)
 {
-        /* extra page for "magic" data */
+        struct kstack_cache *ksc = KSTACK_CACHE(sclass);
         char *kstack;
-        int npages = 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT);
-        kstack = (char *)page_alloc_n(npages);
 
+        if (ksc->ksc_count > 0)
+                return ksc->ksc_stacks[--ksc->ksc_count];
+
+        kstack = (char *)page_alloc_n(KSTACK_NPAGES(sclass));
+        if (NULL != kstack) {
+                uint32_t *guard = (uint32_t *)kstack;
+                uint32_t i;
+
+#ifdef __KSTACK_TCB__
+                KASSERT(0 == ((uintptr_t)kstack & (KSTACK_BLOCK_SIZE - 1)));
+#endif
+                /* Stacks coming back from the cache keep their pattern */
+                for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); ++i)
+                        guard[i] = KSTACK_GUARD_MAGIC;
+        }
         return kstack;
 }
 
@@ -57,63 +138,213 @@ alloc_stack(void)
  * Frees a stack allocated with alloc_stack.
  *
  * @param stack the stack to free
+ * @param sclass the size class the stack was allocated with
  */
 static void
-free_stack(char *stack)
+free_stack(char *stack, kthread_stack_class_t sclass)
+{
+        struct kstack_cache *ksc = KSTACK_CACHE(sclass);
+
+        KASSERT(((uint32_t *)KSTACK_BASE(stack))[-1] == KSTACK_GUARD_MAGIC &&
+                "Kernel stack overflowed into its guard page");
+
+        if (ksc->ksc_count < KSTACK_CACHE_HIWAT) {
+                ksc->ksc_stacks[ksc->ksc_count++] = stack;
+                return;
+        }
+
+        page_free_n(stack, KSTACK_NPAGES(sclass));
+}
+
+int
+kthread_stack_reclaim(int target)
 {
-        page_free_n(stack, 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT));
+        int npages = 0;
+        int sclass;
+
+        /* Largest stacks first, they give back the most per free */
+        for (sclass = KT_STACK_NCLASSES - 1; sclass >= 0; --sclass) {
+                struct kstack_cache *ksc = KSTACK_CACHE(sclass);
+
+                while (ksc->ksc_count > 0 && (0 == target || npages < target)) {
+                        page_free_n(ksc->ksc_stacks[--ksc->ksc_count],
+                                    KSTACK_NPAGES(sclass));
+                        npages += KSTACK_NPAGES(sclass);
+                }
+        }
+
+#ifndef __KSTACK_TCB__
+        /* Let the slab see the free kthread_ts we were holding on to */
+        slab_magazine_drain(&kthread_magazine);
+#endif
+
+        dbg(DBG_THR, "reclaimed %d pages of cached kernel stacks\n", npages);
+        return npages;
+}
+
+/**
+ * Allocates a thread together with its kernel stack. With
+ * __KSTACK_TCB__ the thread is carved out of the stack block itself,
+ * otherwise it comes from the kthread slab.
+ *
+ * @param sclass the size class of the stack
+ * @return a thread with kt_kstack and kt_stackclass set, or NULL if
+ * there is not enough memory available
+ */
+static kthread_t *
+alloc_thread(kthread_stack_class_t sclass)
+{
+        kthread_t *t;
+        char *kstack;
+
+        if (NULL == (kstack = alloc_stack(sclass)))
+                return NULL;
+
+#ifdef __KSTACK_TCB__
+        t = KSTACK_TCB(kstack);
+#else
+        if (NULL == (t = slab_magazine_alloc(&kthread_magazine))) {
+                free_stack(kstack, sclass);
+                return NULL;
+        }
+#endif
+        t->kt_kstack = kstack;
+        t->kt_stackclass = sclass;
+        return t;
+}
+
+/**
+ * Frees a thread allocated with alloc_thread, along with its stack.
+ *
+ * @param t the thread to free
+ */
+static void
+free_thread(kthread_t *t)
+{
+        char *kstack = t->kt_kstack;
+        kthread_stack_class_t sclass = t->kt_stackclass;
+
+#ifndef __KSTACK_TCB__
+        slab_magazine_free(&kthread_magazine, t);
+#endif
+        free_stack(kstack, sclass);
+}
+
+int
+kthread_stack_intact(kthread_t *t)
+{
+        uint32_t *guard = (uint32_t *)KSTACK_BASE(t->kt_kstack);
+        int i;
+
+        /* An overflow reaches the top of the guard page first */
+        for (i = 1; i <= KSTACK_GUARD_CHECK; ++i) {
+                if (KSTACK_GUARD_MAGIC != guard[-i])
+                        return 0;
+        }
+        return 1;
+}
+
+size_t
+kthread_info(const void *arg, char *buf, size_t osize)
+{
+        const kthread_t *t = (const kthread_t *)arg;
+        const ktstats_t *ks = &t->kt_stats;
+        size_t size = osize;
+
+        KASSERT(NULL != t);
+
+        iprintf(&buf, &size, "thread %p (process %d), prio %d, cpu %d\n",
+                t, NULL == t->kt_proc ? -1 : t->kt_proc->p_pid, t->kt_prio, t->kt_cpu);
+        iprintf(&buf, &size, "  switches:  %u voluntary, %u involuntary\n",
+                ks->ks_nvcsw, ks->ks_nivcsw);
+        iprintf(&buf, &size, "  wakeups:   %u\n", ks->ks_nwakeups);
+        iprintf(&buf, &size, "  runnable:  %u kcycles waiting for a CPU\n",
+                (uint32_t)(ks->ks_runqwait >> 10));
+        iprintf(&buf, &size, "  asleep:    %u kcycles\n",
+                (uint32_t)(ks->ks_sleeptime >> 10));
+        return size;
 }
 
 void
 kthread_destroy(kthread_t *t)
 {
         KASSERT(t && t->kt_kstack);
-        free_stack(t->kt_kstack);
         if (list_link_is_linked(&t->kt_plink))
                 list_remove(&t->kt_plink);
+#ifdef __MTP__
+        ktqueue_stats_fini(&t->kt_joinq);
+#endif
 
-        slab_obj_free(kthread_allocator, t);
+        fpu_release(t);
+        free_thread(t);
 }
 
 /*
  * Allocate a new stack with the alloc_stack function. The size of the
  * stack is DEFAULT_STACK_SIZE.
- *
+ */
+kthread_t *
+kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2)
+{
+  return kthread_create_stack(p, func, arg1, arg2, KT_STACK_DEFAULT);
+}
+
+/*
  * Don't forget to initialize the thread context with the
  * context_setup function. The context should have the same pagetable
  * pointer as the process.
  */
 kthread_t *
-kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2)
+kthread_create_stack(struct proc *p, kthread_func_t func, long arg1, void *arg2,
+                     kthread_stack_class_t sclass)
 {
   /* Precondition KASSERT statements begin */
   KASSERT(NULL != p); /* the p argument of this function must be a valid process */
+  KASSERT(sclass >= 0 && sclass < KT_STACK_NCLASSES);
   /* Precondition KASSERT statements end */
   
-  kthread_t *newthread = slab_obj_alloc(kthread_allocator);
+  kthread_t *newthread = alloc_thread(sclass);
   KASSERT(newthread != NULL && "Ran out of memory in kthread creation");
 
-  void *ktstack = alloc_stack();
-  
-  KASSERT(NULL != ktstack && "Ran out of memory in thread context setup.");
   context_setup(&newthread->kt_ctx, func, (int) arg1, arg2, 
-                ktstack, DEFAULT_STACK_SIZE, p->p_pagedir);
+                KSTACK_BASE(newthread->kt_kstack), KSTACK_SIZE(sclass), p->p_pagedir);
   
-  newthread->kt_kstack = ktstack;
-  KASSERT(newthread->kt_kstack != NULL);
   newthread->kt_retval = NULL; // No return value for this thread yet
   newthread->kt_errno = 0;
   newthread->kt_proc = p;
   newthread->kt_cancelled = 0;
   newthread->kt_wchan = NULL; // Thread is not blocked on any queue yet
   newthread->kt_state = KT_RUN;
+  newthread->kt_prio = newthread->kt_baseprio = KT_PRIO_DEFAULT;
+  newthread->kt_inheritprio = KT_PRIO_NONE;
+  newthread->kt_cpu = curcpu()->cpu_id; // start out next to our creator
+  memset(&newthread->kt_stats, 0, sizeof(newthread->kt_stats));
+  newthread->kt_fpu = NULL; // allocated on first FPU use, see proc/fpu.h
+#ifdef __MTP__
+  newthread->kt_detached = 0;
+  sched_queue_init(&newthread->kt_joinq);
+#endif
 
   list_link_init(&newthread->kt_qlink);
+  list_init(&newthread->kt_mutexes);
+  newthread->kt_blockedon = NULL;
   list_insert_tail(&p->p_threads, &(newthread->kt_plink));
 
   return newthread;
 }
 
+void
+kthread_setprio(kthread_t *kthr, int prio)
+{
+  KASSERT(NULL != kthr);
+  KASSERT(prio >= KT_PRIO_MAX && prio <= KT_PRIO_MIN);
+
+  kthr->kt_baseprio = prio;
+  if (!list_link_is_linked(&kthr->kt_qlink)) {
+    kthr->kt_prio = KT_EFFECTIVE_PRIO(kthr); // not queued, safe to move levels
+  }
+}
+
 /*
  * If the thread to be cancelled is the current thread, this is
  * equivalent to calling kthread_exit. Otherwise, the thread is
@@ -147,6 +378,85 @@ kthread_cancel(kthread_t *kthr, void *retval)
   sched_cancel(kthr);
 }
 
+/*
+ * Does what sched_cancel() does for one thread, but leaves the interrupt
+ * level to the caller so a whole process costs one raise and restore.
+ */
+static int
+kthread_cancel_one(kthread_t *kthr, void *retval)
+{
+        kmutex_t *mtx;
+        int woken = 0;
+
+        if (KT_EXITED == kthr->kt_state || kthr->kt_cancelled)
+                return 0;
+
+        kthr->kt_retval = retval;
+        kthr->kt_cancelled = 1;
+#ifdef __MTP__
+        if (!kthr->kt_detached && sched_queue_empty(&kthr->kt_joinq))
+                kthr->kt_detached = 1;
+#endif
+        /* A mutex's wait queue can only be changed under its km_lock */
+        if (NULL != (mtx = kthr->kt_blockedon))
+                spinlock_lock(&mtx->km_lock);
+        if (KT_SLEEP_CANCELLABLE == kthr->kt_state) {
+                ktqueue_remove(kthr->kt_wchan, kthr);
+                sched_make_runnable(kthr);
+                woken = 1;
+        }
+        if (NULL != mtx)
+                spinlock_unlock(&mtx->km_lock);
+        return woken;
+}
+
+static int
+kthread_cancel_threads(proc_t *p, void *retval)
+{
+        kthread_t *kthr;
+        int woken = 0;
+
+        list_iterate_begin(&p->p_threads, kthr, kthread_t, kt_plink) {
+                if (kthr != curthr)
+                        woken += kthread_cancel_one(kthr, retval);
+        } list_iterate_end();
+        return woken;
+}
+
+int
+kthread_cancel_proc(proc_t *p, void *retval)
+{
+        uint8_t oldipl = intr_getipl();
+        int woken;
+
+        KASSERT(NULL != p);
+
+        intr_setipl(IPL_HIGH);
+        woken = kthread_cancel_threads(p, retval);
+        intr_setipl(oldipl);
+        return woken;
+}
+
+int
+kthread_cancel_all(void *retval)
+{
+        uint8_t oldipl = intr_getipl();
+        proc_t *p;
+        int woken = 0;
+
+        intr_setipl(IPL_HIGH);
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                if (PID_IDLE == p->p_pid || p == curproc ||
+                    (NULL != p->p_pproc && PID_IDLE == p->p_pproc->p_pid))
+                        continue;
+                woken += kthread_cancel_threads(p, retval);
+        } list_iterate_end();
+        intr_setipl(oldipl);
+
+        dbg(DBG_THR, "cancelled all processes, woke %d threads\n", woken);
+        return woken;
+}
+
 /*
  * You need to set the thread's retval field and alert the current
  * process that a thread is exiting via proc_thread_exited. You should
@@ -171,9 +481,18 @@ kthread_exit(void *retval)
   /* this thread must not be part of any list */  
   KASSERT(!curthr->kt_qlink.l_next && !curthr->kt_qlink.l_prev); 
   KASSERT(curthr->kt_proc == curproc); /* this thread belongs to curproc */
+  KASSERT(list_empty(&curthr->kt_mutexes)); /* dying with a mutex held */
   /* Middle KASSERT statements end */
 
   curthr->kt_state = KT_EXITED; // set zombie flag before making zombie
+#ifdef __MTP__
+  if (curthr->kt_detached) {
+    kthread_reapd_enqueue(curthr); // nobody will join, reapd frees it
+  } else {
+    // A joiner runs as soon as we switch away instead of waiting its turn
+    sched_handoff_on(&curthr->kt_joinq);
+  }
+#endif
   proc_thread_exited(retval); // make zombie here
   panic("Should never get here! proc_thread_exited() will kill thread.");
 }
@@ -192,24 +511,13 @@ kthread_clone(kthread_t *thr)
   KASSERT(KT_RUN == thr->kt_state); /* the thread you are cloning must be in the running or runnable state */
   /* End precondition */
 
-  kthread_t *newthr = slab_obj_alloc(kthread_allocator);
+  kthread_t *newthr = alloc_thread(thr->kt_stackclass);
   KASSERT(newthr != NULL && "Ran out of memory in kthread clone");
 
-  void *contextstack = alloc_stack();
-  KASSERT(NULL != contextstack &&
-          "Ran out of memory in kthread clone context setup.");
-
   // Cloned thread needs its own context
   // Set rest of context_t in fork
-  newthr->kt_ctx.c_kstack = (uint32_t) contextstack; // assign new stack
-  newthr->kt_ctx.c_kstacksz = DEFAULT_STACK_SIZE;
-
-  // Cloned thread needs its own kernel stack
-  void *kernelstack = alloc_stack(); 
-  KASSERT(NULL != kernelstack &&
-          "Ran out of memory in kthread clone stack setup.");
-
-  newthr->kt_kstack = kernelstack; // Set up in fork 
+  newthr->kt_ctx.c_kstack = (uint32_t) KSTACK_BASE(newthr->kt_kstack); // same stack as the thread
+  newthr->kt_ctx.c_kstacksz = KSTACK_SIZE(thr->kt_stackclass);
 
   newthr->kt_retval = thr->kt_retval;
   newthr->kt_errno = thr->kt_errno;
@@ -217,10 +525,25 @@ kthread_clone(kthread_t *thr)
   newthr->kt_cancelled = thr->kt_cancelled;
   newthr->kt_wchan = thr->kt_wchan; // Queue that thr is blocked on
   newthr->kt_state = KT_RUN;
+  newthr->kt_prio = newthr->kt_baseprio = thr->kt_baseprio; // not thr's aged prio
+  newthr->kt_inheritprio = KT_PRIO_NONE; // holds no mutexes
+  newthr->kt_cpu = thr->kt_cpu;
+  memset(&newthr->kt_stats, 0, sizeof(newthr->kt_stats)); // counts start over
+#ifdef __MTP__
+  newthr->kt_detached = thr->kt_detached;
+  sched_queue_init(&newthr->kt_joinq); // nobody is joining the clone yet
+#endif
+
+  // FPU registers are thread state too
+  if (fpu_clone(newthr, thr) < 0) {
+    panic("Ran out of memory in kthread clone FPU setup.");
+  }
 
   // Initialize list links
   list_link_init(&newthr->kt_qlink);
   list_link_init(&newthr->kt_plink);
+  list_init(&newthr->kt_mutexes); // mutexes stay with thr
+  newthr->kt_blockedon = NULL;
 
   /* Begin postcondition: let newthr be the new thread */
   KASSERT(KT_RUN == newthr->kt_state); /* new thread starts in the runnable state */
@@ -238,38 +561,158 @@ kthread_clone(kthread_t *thr)
 int
 kthread_detach(kthread_t *kthr)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_detach");
+        KASSERT(NULL != kthr);
+
+        if (kthr->kt_detached || !sched_queue_empty(&kthr->kt_joinq))
+                return -EINVAL;
+
+        kthr->kt_detached = 1;
+        /* Already dead and nobody is going to join it now */
+        if (KT_EXITED == kthr->kt_state)
+                kthread_reapd_enqueue(kthr);
         return 0;
 }
 
+/*
+ * Only one thread may join a given thread. Freeing its stack here is
+ * safe because the kernel is uniprocessor and not preemptive: the
+ * exiting thread makes no blocking call between waking us and its
+ * final sched_switch(), so we cannot run until it has switched away
+ * for good. The handoff in kthread_exit only decides that we run next.
+ */
 int
 kthread_join(kthread_t *kthr, void **retval)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_join");
+        int err;
+
+        KASSERT(NULL != kthr);
+
+        if (kthr == curthr)
+                return -EDEADLK;
+        if (kthr->kt_detached || kthr->kt_proc != curproc ||
+            !sched_queue_empty(&kthr->kt_joinq))
+                return -EINVAL;
+
+        while (KT_EXITED != kthr->kt_state) {
+                if ((err = sched_cancellable_sleep_on(&kthr->kt_joinq)) < 0)
+                        return err;
+        }
+
+        if (NULL != retval)
+                *retval = kthr->kt_retval;
+        kthread_destroy(kthr);
         return 0;
 }
 
 /* ------------------------------------------------------------------ */
 /* -------------------------- REAPER DAEMON ------------------------- */
 /* ------------------------------------------------------------------ */
+/*
+ * Dead detached threads are not freed on the exiting thread's way out.
+ * They queue up on kthread_reapd_deadlist and the reaper is only woken
+ * once REAPD_BATCH of them have piled up, or every REAPD_INTERVAL
+ * ticks, so it frees them a batch at a time. Their stacks go back to
+ * the stack cache and their kthread_ts back to the slab.
+ *
+ * A thread is taken off its process's p_threads list when it is
+ * handed to the reaper, so from then on it belongs to the reaper
+ * alone. proc_thread_exited() must not expect to find a detached
+ * thread on p_threads, and do_waitpid() can tear the process down
+ * without waiting for it: the reaper never touches the proc_t, so the
+ * process may be freed before its detached threads are.
+ *
+ * The dead list and reapd_ndead are only touched under the boot CPU's
+ * run-queue lock (REAPD_LOCK), and nothing is freed or woken while it
+ * is held. That keeps the list itself consistent, but it does not make
+ * the reaper SMP-safe: a reaper on another CPU can free the stack of a
+ * thread that is still on its way through proc_thread_exited(). On a
+ * uniprocessor the exiting thread switches away for good before the
+ * reaper can run; with __SMP__ the free would first have to wait for
+ * that final switch.
+ */
+#define REAPD_LOCK      (&cpus[0].cpu_runqlock)
+
+static void
+kthread_reapd_enqueue(kthread_t *kthr)
+{
+        int ndead;
+
+        KASSERT(KT_EXITED == kthr->kt_state && kthr->kt_detached);
+        KASSERT(!list_link_is_linked(&kthr->kt_qlink));
+
+        if (list_link_is_linked(&kthr->kt_plink))
+                list_remove(&kthr->kt_plink);
+
+        spinlock_lock(REAPD_LOCK);
+        list_insert_tail(&kthread_reapd_deadlist, &kthr->kt_qlink);
+        ndead = ++reapd_ndead;
+        spinlock_unlock(REAPD_LOCK);
+
+        if (ndead >= REAPD_BATCH)
+                sched_wakeup_on(&reapd_waitq);
+}
+
+static void
+kthread_reapd_drain()
+{
+        kthread_t *kthr;
+        list_t dead;
+        int ndead;
+
+        list_init(&dead);
+        spinlock_lock(REAPD_LOCK);
+        list_splice_tail(&dead, &kthread_reapd_deadlist);
+        ndead = reapd_ndead;
+        reapd_ndead = 0;
+        spinlock_unlock(REAPD_LOCK);
+
+        dbgt(DBG_THR, "reaping %d dead threads\n", ndead);
+        list_iterate_begin(&dead, kthr, kthread_t, kt_qlink) {
+                list_remove(&kthr->kt_qlink);
+                kthread_destroy(kthr);
+        } list_iterate_end();
+}
+
 static __attribute__((unused)) void
 kthread_reapd_init()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_init");
+        sched_queue_init(&reapd_waitq);
+        list_init(&kthread_reapd_deadlist);
+
+        reapd = proc_create("reapd");
+        KASSERT(NULL != reapd);
+
+        reapd_thr = kthread_create_stack(reapd, kthread_reapd_run, 0, NULL,
+                                         KT_STACK_SMALL);
+        KASSERT(NULL != reapd_thr);
+        sched_make_runnable(reapd_thr);
 }
 init_func(kthread_reapd_init);
 init_depends(sched_init);
+init_depends(cpu_init);
 
 void
 kthread_reapd_shutdown()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_shutdown");
+        KASSERT(NULL != reapd_thr);
+
+        reapd_exiting = 1;
+        sched_wakeup_on(&reapd_waitq);
 }
 
 static void *
 kthread_reapd_run(int arg1, void *arg2)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_run");
+        while (!reapd_exiting) {
+                /* Wake up now and then so a partial batch is not stuck */
+                if (reapd_ndead < REAPD_BATCH)
+                        sched_sleep_on_timeout(&reapd_waitq, REAPD_INTERVAL);
+                if (reapd_ndead > 0)
+                        kthread_reapd_drain();
+        }
+
+        /* Nothing frees threads that die after this point */
+        kthread_reapd_drain();
         return (void *) 0;
 }
 #endif
@@ -0,0 +1,278 @@
+#include "config.h"
+#include "globals.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+#include "util/printf.h"
+#include "util/trace.h"
+
+#include "proc/kthread.h"
+#include "proc/sched.h"
+
+#ifdef __SCHED_STATS__
+#define KTQUEUE_HIST_TABLE      1024    /* queues with a histogram, a power of 2 */
+#define KTQUEUE_HIST_PROBE      8       /* slots a queue's histogram may use */
+
+typedef struct ktqueue_hist {
+        const ktqueue_t *qh_q;          /* NULL if the slot is free */
+        uint32_t        qh_hist[KTQUEUE_HIST_BUCKETS];
+} ktqueue_hist_t;
+
+/*
+ * Open addressing on the queue's address. A queue's histogram is in
+ * one of the KTQUEUE_HIST_PROBE slots from its hash, and lookups look
+ * at all of them rather than stopping at a free one, so a slot can be
+ * freed just by clearing qh_q. If all of them are taken the sample is
+ * dropped.
+ */
+static ktqueue_hist_t ktqueue_hists[KTQUEUE_HIST_TABLE];
+static uint32_t ktqueue_hist_dropped = 0; /* samples lost to a full table */
+
+static ktqueue_hist_t *
+ktqueue_hist_lookup(const ktqueue_t *q, int create)
+{
+        uint32_t h = ((uintptr_t)q >> 2) & (KTQUEUE_HIST_TABLE - 1);
+        ktqueue_hist_t *qh, *avail = NULL;
+        int i, b;
+
+        for (i = 0; i < KTQUEUE_HIST_PROBE; ++i) {
+                qh = &ktqueue_hists[(h + i) & (KTQUEUE_HIST_TABLE - 1)];
+                if (qh->qh_q == q)
+                        return qh;
+                if (NULL == qh->qh_q && NULL == avail)
+                        avail = qh;
+        }
+
+        if (!create || NULL == avail)
+                return NULL;
+        avail->qh_q = q;
+        for (b = 0; b < KTQUEUE_HIST_BUCKETS; ++b)
+                avail->qh_hist[b] = 0;
+        return avail;
+}
+#endif
+
+void
+ktqueue_stats_init(ktqueue_t *q)
+{
+        /* A queue reusing the address of a dead one starts afresh */
+        ktqueue_stats_fini(q);
+}
+
+void
+ktqueue_stats_fini(ktqueue_t *q)
+{
+#ifdef __SCHED_STATS__
+        ktqueue_hist_t *qh;
+
+        KASSERT(0 == q->tq_size);
+        if (NULL != (qh = ktqueue_hist_lookup(q, 0)))
+                qh->qh_q = NULL;
+#endif
+}
+
+/*
+ * Called as thr goes on q. A thread that puts itself on a queue is
+ * giving up the CPU: voluntarily if it is going to sleep, involuntarily
+ * if it is still runnable and going back on a run queue.
+ */
+static void
+ktqueue_stats_enter(kthread_t *thr)
+{
+        if (thr == curthr) {
+                if (KT_RUN == thr->kt_state)
+                        thr->kt_stats.ks_nivcsw++;
+                else
+                        thr->kt_stats.ks_nvcsw++;
+        }
+        thr->kt_stats.ks_qstamp = trace_cycles();
+}
+
+/* Called as thr comes off q, having waited there since ks_qstamp */
+static void
+ktqueue_stats_leave(ktqueue_t *q, kthread_t *thr)
+{
+        uint64_t wait = trace_cycles() - thr->kt_stats.ks_qstamp;
+#ifdef __SCHED_STATS__
+        ktqueue_hist_t *qh;
+        int bucket = 0;
+#endif
+
+        if (KT_RUN == thr->kt_state) {
+                thr->kt_stats.ks_runqwait += wait;
+        } else {
+                thr->kt_stats.ks_sleeptime += wait;
+                thr->kt_stats.ks_nwakeups++;
+        }
+
+#ifdef __SCHED_STATS__
+        qh = ktqueue_hist_lookup(q, 1);
+        if (NULL == qh) {
+                ktqueue_hist_dropped++;
+                return;
+        }
+        while (bucket < KTQUEUE_HIST_BUCKETS - 1 && (wait >>= 4) > 0)
+                bucket++;
+        qh->qh_hist[bucket]++;
+#endif
+}
+
+static void
+ktqueue_link(ktqueue_t *q, kthread_t *thr, int head)
+{
+        KASSERT(!list_link_is_linked(&thr->kt_qlink));
+
+        if (head)
+                list_insert_head(&q->tq_list, &thr->kt_qlink);
+        else
+                list_insert_tail(&q->tq_list, &thr->kt_qlink);
+        thr->kt_wchan = q;
+        q->tq_size++;
+}
+
+static void
+ktqueue_unlink(ktqueue_t *q, kthread_t *thr)
+{
+        KASSERT(thr->kt_wchan == q);
+        KASSERT(q->tq_size > 0);
+
+        list_remove(&thr->kt_qlink);
+        thr->kt_wchan = NULL;
+        q->tq_size--;
+}
+
+void
+ktqueue_enqueue(ktqueue_t *q, kthread_t *thr)
+{
+        ktqueue_stats_enter(thr);
+        ktqueue_link(q, thr, 0);
+}
+
+void
+ktqueue_enqueue_head(ktqueue_t *q, kthread_t *thr)
+{
+        ktqueue_stats_enter(thr);
+        ktqueue_link(q, thr, 1);
+}
+
+kthread_t *
+ktqueue_dequeue(ktqueue_t *q)
+{
+        kthread_t *thr;
+
+        if (list_empty(&q->tq_list))
+                return NULL;
+
+        thr = list_head(&q->tq_list, kthread_t, kt_qlink);
+        ktqueue_remove(q, thr);
+        return thr;
+}
+
+void
+ktqueue_remove(ktqueue_t *q, kthread_t *thr)
+{
+        ktqueue_unlink(q, thr);
+        ktqueue_stats_leave(q, thr);
+}
+
+void
+ktqueue_move(ktqueue_t *from, ktqueue_t *to, kthread_t *thr)
+{
+        ktqueue_unlink(from, thr);
+        ktqueue_link(to, thr, 0);
+}
+
+static int
+ktqueue_move_all(ktqueue_t *dst, ktqueue_t *src, int account)
+{
+        kthread_t *thr;
+        int moved = src->tq_size;
+
+        list_iterate_begin(&src->tq_list, thr, kthread_t, kt_qlink) {
+                if (account) {
+                        ktqueue_stats_leave(src, thr);
+                        thr->kt_stats.ks_qstamp = trace_cycles();
+                }
+                thr->kt_wchan = dst;
+        } list_iterate_end();
+
+        list_splice_tail(&dst->tq_list, &src->tq_list);
+        dst->tq_size += moved;
+        src->tq_size = 0;
+        return moved;
+}
+
+int
+ktqueue_splice(ktqueue_t *dst, ktqueue_t *src)
+{
+        return ktqueue_move_all(dst, src, 1);
+}
+
+int
+sched_wakeup_n(ktqueue_t *q, int n)
+{
+        int woken = 0;
+
+        while (woken < n && NULL != sched_wakeup_on(q))
+                woken++;
+        return woken;
+}
+
+int
+sched_morph_on(ktqueue_t *from, ktqueue_t *to, int n)
+{
+        uint8_t oldipl = intr_getipl();
+        kthread_t *thr;
+        int moved = 0;
+
+        KASSERT(from != to);
+
+        intr_setipl(IPL_HIGH);
+        /* Morphed threads are still asleep, so their wait goes on */
+        if (n < 0 || n >= from->tq_size) {
+                moved = ktqueue_move_all(to, from, 0);
+        } else {
+                while (moved < n) {
+                        thr = list_head(&from->tq_list, kthread_t, kt_qlink);
+                        KASSERT(KT_SLEEP == thr->kt_state ||
+                                KT_SLEEP_CANCELLABLE == thr->kt_state);
+                        ktqueue_move(from, to, thr);
+                        moved++;
+                }
+        }
+        intr_setipl(oldipl);
+        return moved;
+}
+
+size_t
+ktqueue_info(const void *arg, char *buf, size_t osize)
+{
+        const ktqueue_t *q = (const ktqueue_t *)arg;
+        size_t size = osize;
+#ifdef __SCHED_STATS__
+        ktqueue_hist_t *qh;
+        int i;
+#endif
+
+        KASSERT(NULL != q);
+
+        iprintf(&buf, &size, "queue %p: %d waiting\n", q, q->tq_size);
+#ifdef __SCHED_STATS__
+        qh = ktqueue_hist_lookup(q, 0);
+        if (NULL == qh) {
+                iprintf(&buf, &size, "  no waits recorded\n");
+                return size;
+        }
+        for (i = 0; i < KTQUEUE_HIST_BUCKETS - 1; ++i) {
+                iprintf(&buf, &size, "  < 2^%-2d cycles: %u\n",
+                        4 * (i + 1), qh->qh_hist[i]);
+        }
+        iprintf(&buf, &size, "  longer:        %u\n", qh->qh_hist[i]);
+        if (ktqueue_hist_dropped > 0)
+                iprintf(&buf, &size, "  (%u samples dropped, table full)\n",
+                        ktqueue_hist_dropped);
+#endif
+        return size;
+}
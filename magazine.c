@@ -0,0 +1,101 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "util/debug.h"
+
+#include "proc/cpu.h"
+
+#include "mm/magazine.h"
+#include "mm/slab.h"
+
+#define SM_LOCAL(mag) (&(mag)->sm_cpu[curcpu()->cpu_id])
+
+#ifdef SLAB_CHECK_FREE
+static void
+slab_magazine_check_free(slab_magazine_t *mag, void *obj)
+{
+        int i, j;
+
+        for (i = 0; i < NCPUS; ++i) {
+                for (j = 0; j < mag->sm_cpu[i].smc_count; ++j)
+                        KASSERT(mag->sm_cpu[i].smc_objs[j] != obj && "double free");
+        }
+}
+#endif
+
+void
+slab_magazine_init(slab_magazine_t *mag, slab_allocator_t *slab)
+{
+        int i;
+
+        KASSERT(NULL != slab);
+
+        mag->sm_slab = slab;
+        for (i = 0; i < NCPUS; ++i)
+                mag->sm_cpu[i].smc_count = 0;
+}
+
+void *
+slab_magazine_alloc(slab_magazine_t *mag)
+{
+        struct slab_magazine_cpu *smc = SM_LOCAL(mag);
+
+        if (smc->smc_count > 0)
+                return smc->smc_objs[--smc->smc_count];
+
+        return slab_obj_alloc(mag->sm_slab);
+}
+
+void
+slab_magazine_free(slab_magazine_t *mag, void *obj)
+{
+        struct slab_magazine_cpu *smc = SM_LOCAL(mag);
+
+        KASSERT(NULL != obj);
+#ifdef SLAB_CHECK_FREE
+        slab_magazine_check_free(mag, obj);
+#endif
+
+        if (smc->smc_count < SLAB_MAGAZINE_SIZE) {
+                smc->smc_objs[smc->smc_count++] = obj;
+                return;
+        }
+
+        slab_obj_free(mag->sm_slab, obj);
+}
+
+int
+slab_magazine_alloc_n(slab_magazine_t *mag, void **objs, int n)
+{
+        int i;
+
+        for (i = 0; i < n; ++i) {
+                if (NULL == (objs[i] = slab_magazine_alloc(mag))) {
+                        slab_magazine_free_n(mag, objs, i);
+                        return -ENOMEM;
+                }
+        }
+        return 0;
+}
+
+void
+slab_magazine_free_n(slab_magazine_t *mag, void **objs, int n)
+{
+        int i;
+
+        for (i = 0; i < n; ++i)
+                slab_magazine_free(mag, objs[i]);
+}
+
+int
+slab_magazine_drain(slab_magazine_t *mag)
+{
+        struct slab_magazine_cpu *smc = SM_LOCAL(mag);
+        int n = smc->smc_count;
+
+        while (smc->smc_count > 0)
+                slab_obj_free(mag->sm_slab, smc->smc_objs[--smc->smc_count]);
+        return n;
+}
@@ -0,0 +1,108 @@
+#include "types.h"
+
+#include "util/string.h"
+
+/*
+ * x86 versions of the hot string routines. Anything of at least
+ * MEMOPS_SMALL bytes is done by the string instructions a word at a
+ * time once the destination is word aligned; shorter runs are not
+ * worth the setup and go a byte at a time. No SSE: the kernel does not
+ * save FPU/SSE state for its own use.
+ */
+
+#define MEMOPS_SMALL    16
+
+/* strlen reads char data through this, so it must be allowed to alias */
+typedef uint32_t __attribute__((may_alias)) memops_word_t;
+
+void *
+memcpy(void *dest, const void *src, size_t count)
+{
+        char *d = dest;
+        const char *s = src;
+        size_t head;
+        int d0, d1, d2;
+
+        if (count < MEMOPS_SMALL) {
+                while (count--)
+                        *d++ = *s++;
+                return dest;
+        }
+
+        /* Only worth aligning if both ends can be aligned at once */
+        if (0 == (((uintptr_t)d ^ (uintptr_t)s) & 3)) {
+                head = (-(uintptr_t)d) & 3;
+                count -= head;
+                while (head--)
+                        *d++ = *s++;
+                __asm__ volatile ("rep movsl"
+                                  : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+                                  : "0" (count >> 2), "1" (d), "2" (s)
+                                  : "memory");
+                d += count & ~3;
+                s += count & ~3;
+                count &= 3;
+        }
+        __asm__ volatile ("rep movsb"
+                          : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+                          : "0" (count), "1" (d), "2" (s)
+                          : "memory");
+        return dest;
+}
+
+void *
+memset(void *s, int c, size_t count)
+{
+        char *d = s;
+        uint32_t word = (uint8_t)c * 0x01010101U;
+        size_t head;
+        int d0, d1;
+
+        if (count < MEMOPS_SMALL) {
+                while (count--)
+                        *d++ = (char)c;
+                return s;
+        }
+
+        head = (-(uintptr_t)d) & 3;
+        count -= head;
+        while (head--)
+                *d++ = (char)c;
+        __asm__ volatile ("rep stosl"
+                          : "=&c" (d0), "=&D" (d1)
+                          : "0" (count >> 2), "1" (d), "a" (word)
+                          : "memory");
+        d += count & ~3;
+        for (count &= 3; count > 0; --count)
+                *d++ = (char)c;
+        return s;
+}
+
+/*
+ * Once aligned, reading a whole word at a time never crosses into a
+ * page the string does not touch, so it cannot fault where the
+ * byte-wise loop would not.
+ */
+size_t
+strlen(const char *s)
+{
+        const char *p = s;
+        const memops_word_t *w;
+        uint32_t x;
+
+        for (; 0 != ((uintptr_t)p & 3); ++p) {
+                if ('\0' == *p)
+                        return p - s;
+        }
+
+        /* (x - 0x01010101) & ~x & 0x80808080 is non-zero iff x has a zero byte */
+        for (w = (const memops_word_t *)p; ; ++w) {
+                x = *w;
+                if ((x - 0x01010101U) & ~x & 0x80808080U)
+                        break;
+        }
+
+        for (p = (const char *)w; '\0' != *p; ++p)
+                ;
+        return p - s;
+}
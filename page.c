@@ -0,0 +1,233 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+#include "util/printf.h"
+
+#include "mm/page.h"
+
+/*
+ * A buddy allocator. Free memory is kept as blocks of 2^order pages,
+ * order < PAGE_NSIZES, each aligned to its own size and kept on the
+ * free list for its order. Allocating n pages splits the smallest
+ * block that fits and hands the pages past n straight back, so a 15
+ * page kernel stack costs 15 pages and not 16. Freeing merges a block
+ * with its buddy for as long as the buddy is free too, which is what
+ * keeps large blocks available after long uptimes.
+ *
+ * The free list links live in the free pages themselves. Each range
+ * given to page_add_range keeps one byte per page at its start, which
+ * is PAGE_INFO_FREE | order for the first page of a free block and 0
+ * for every other page.
+ */
+
+#define PAGE_MAX_RANGES         8
+#define PAGE_INFO_FREE          0x80
+#define PAGE_INFO_ORDER         0x7f
+
+typedef struct page_range {
+        uint32_t        pr_startpn;     /* first page managed */
+        uint32_t        pr_endpn;       /* one past the last page managed */
+        uint8_t        *pr_info;        /* one byte per page managed */
+} page_range_t;
+
+static page_range_t page_ranges[PAGE_MAX_RANGES];
+static int page_nranges = 0;
+
+static list_t page_freelist[PAGE_NSIZES];
+static uint32_t page_nblocks[PAGE_NSIZES]; /* blocks on each free list */
+static uint32_t page_nfree = 0;
+
+static page_range_t *
+page_find_range(uint32_t pn)
+{
+        int i;
+
+        for (i = 0; i < page_nranges; ++i) {
+                if (pn >= page_ranges[i].pr_startpn && pn < page_ranges[i].pr_endpn)
+                        return &page_ranges[i];
+        }
+        return NULL;
+}
+
+#define PAGE_INFO(pr, pn) ((pr)->pr_info[(pn) - (pr)->pr_startpn])
+
+static void
+page_link(page_range_t *pr, uint32_t pn, int order)
+{
+        KASSERT(0 == PAGE_INFO(pr, pn));
+
+        PAGE_INFO(pr, pn) = PAGE_INFO_FREE | order;
+        list_insert_head(&page_freelist[order], (list_link_t *)PN_TO_ADDR(pn));
+        page_nblocks[order]++;
+        page_nfree += 1U << order;
+}
+
+static void
+page_unlink(page_range_t *pr, uint32_t pn, int order)
+{
+        KASSERT((PAGE_INFO_FREE | order) == PAGE_INFO(pr, pn));
+
+        PAGE_INFO(pr, pn) = 0;
+        list_remove((list_link_t *)PN_TO_ADDR(pn));
+        page_nblocks[order]--;
+        page_nfree -= 1U << order;
+}
+
+/* Frees one aligned block, merging it with its buddy where possible */
+static void
+page_free_block(uint32_t pn, int order)
+{
+        page_range_t *pr = page_find_range(pn);
+        uint32_t buddy;
+
+        KASSERT(NULL != pr && "freeing a page that was never added");
+        KASSERT(0 == (pn & ((1U << order) - 1)));
+
+        while (order < PAGE_NSIZES - 1) {
+                buddy = pn ^ (1U << order);
+                if (buddy < pr->pr_startpn || buddy >= pr->pr_endpn ||
+                    (PAGE_INFO_FREE | order) != PAGE_INFO(pr, buddy))
+                        break;
+
+                page_unlink(pr, buddy, order);
+                pn &= ~(1U << order);
+                order++;
+        }
+        page_link(pr, pn, order);
+}
+
+/* Frees npages pages from pn on, which need not make up a single block */
+static void
+page_free_pages(uint32_t pn, uint32_t npages)
+{
+        int order;
+
+        while (npages > 0) {
+                for (order = PAGE_NSIZES - 1; order > 0; --order) {
+                        if (0 == (pn & ((1U << order) - 1)) && (1U << order) <= npages)
+                                break;
+                }
+                page_free_block(pn, order);
+                pn += 1U << order;
+                npages -= 1U << order;
+        }
+}
+
+void
+page_add_range(uintptr_t start, uintptr_t end)
+{
+        page_range_t *pr;
+        uint32_t startpn = ADDR_TO_PN(PAGE_ALIGN_UP(start));
+        uint32_t endpn = ADDR_TO_PN(PAGE_ALIGN_DOWN(end));
+        uint32_t ninfo, i;
+
+        KASSERT(page_nranges < PAGE_MAX_RANGES);
+        if (0 == page_nranges) {
+                for (i = 0; i < PAGE_NSIZES; ++i)
+                        list_init(&page_freelist[i]);
+        }
+        if (endpn <= startpn)
+                return;
+
+        /* The per-page info comes out of the front of the range */
+        ninfo = ((endpn - startpn) + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (ninfo >= endpn - startpn)
+                return;
+
+        pr = &page_ranges[page_nranges++];
+        pr->pr_info = (uint8_t *)PN_TO_ADDR(startpn);
+        pr->pr_startpn = startpn + ninfo;
+        pr->pr_endpn = endpn;
+        for (i = 0; i < endpn - pr->pr_startpn; ++i)
+                pr->pr_info[i] = 0;
+
+        page_free_pages(pr->pr_startpn, endpn - pr->pr_startpn);
+        dbg(DBG_PAGEALLOC, "added %u pages at 0x%08x\n",
+            endpn - pr->pr_startpn, (uint32_t)PN_TO_ADDR(pr->pr_startpn));
+}
+
+void *
+page_alloc_n(uint32_t npages)
+{
+        page_range_t *pr;
+        list_link_t *link;
+        uint32_t pn;
+        int order, want;
+
+        KASSERT(npages > 0);
+        KASSERT(page_nranges > 0 && "page_alloc before page_add_range");
+
+        for (want = 0; want < PAGE_NSIZES && (1U << want) < npages; ++want)
+                ;
+        for (order = want; order < PAGE_NSIZES; ++order) {
+                if (!list_empty(&page_freelist[order]))
+                        break;
+        }
+        if (order >= PAGE_NSIZES) {
+                dbg(DBG_PAGEALLOC, "no free block for %u pages\n", npages);
+                return NULL;
+        }
+
+        link = page_freelist[order].l_next;
+        pn = ADDR_TO_PN(link);
+        pr = page_find_range(pn);
+        page_unlink(pr, pn, order);
+
+        /* Give back the upper halves we do not need... */
+        while (order > want) {
+                order--;
+                page_link(pr, pn + (1U << order), order);
+        }
+        /* ...and the pages past npages in the block we kept */
+        page_free_pages(pn + npages, (1U << want) - npages);
+
+        return PN_TO_ADDR(pn);
+}
+
+void
+page_free_n(void *start, uint32_t npages)
+{
+        KASSERT(PAGE_ALIGNED(start) && npages > 0);
+
+        page_free_pages(ADDR_TO_PN(start), npages);
+}
+
+void *
+page_alloc(void)
+{
+        return page_alloc_n(1);
+}
+
+void
+page_free(void *addr)
+{
+        page_free_n(addr, 1);
+}
+
+uint32_t
+page_free_count()
+{
+        return page_nfree;
+}
+
+size_t
+page_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        int order, largest = -1;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "%u pages free\n", page_nfree);
+        for (order = 0; order < PAGE_NSIZES; ++order) {
+                iprintf(&buf, &size, "  order %d (%3u pages): %u free blocks\n",
+                        order, 1U << order, page_nblocks[order]);
+                if (page_nblocks[order] > 0)
+                        largest = order;
+        }
+        if (largest >= 0)
+                iprintf(&buf, &size, "largest free block: %u pages\n", 1U << largest);
+        return size;
+}
@@ -0,0 +1,99 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+
+#include "proc/pid.h"
+#include "proc/proc.h"
+
+#define PID_WORD_BITS   32
+#define PID_NWORDS      (PROC_MAX_COUNT / PID_WORD_BITS)
+
+static uint32_t pid_bitmap[PID_NWORDS];  /* bit set iff the PID is in use */
+static pid_t pid_last = -1;              /* the PID handed out last */
+static list_t pid_hash[PID_HASH_SIZE];
+
+#define PID_HASH(pid) (&pid_hash[(uint32_t)(pid) & (PID_HASH_SIZE - 1)])
+
+void
+pid_init()
+{
+        int i;
+
+        KASSERT(0 == (PROC_MAX_COUNT % PID_WORD_BITS));
+        KASSERT(0 == (PID_HASH_SIZE & (PID_HASH_SIZE - 1)));
+
+        for (i = 0; i < PID_NWORDS; ++i)
+                pid_bitmap[i] = 0;
+        for (i = 0; i < PID_HASH_SIZE; ++i)
+                list_init(&pid_hash[i]);
+}
+init_func(pid_init);
+
+pid_t
+pid_alloc()
+{
+        pid_t start = (pid_last + 1) % PROC_MAX_COUNT;
+        uint32_t avail;
+        int i, word, bit;
+
+        /* The start word is looked at twice: above start, then below it */
+        for (i = 0; i <= PID_NWORDS; ++i) {
+                word = (start / PID_WORD_BITS + i) % PID_NWORDS;
+                avail = ~pid_bitmap[word];
+                if (0 == i)
+                        avail &= ~0U << (start % PID_WORD_BITS);
+                if (0 == avail)
+                        continue;
+
+                bit = __builtin_ctz(avail);
+                pid_bitmap[word] |= 1U << bit;
+                pid_last = word * PID_WORD_BITS + bit;
+                return pid_last;
+        }
+
+        dbg(DBG_PROC, "out of PIDs\n");
+        return -EAGAIN;
+}
+
+void
+pid_free(pid_t pid)
+{
+        KASSERT(pid >= 0 && pid < PROC_MAX_COUNT);
+        KASSERT(pid_bitmap[pid / PID_WORD_BITS] & (1U << (pid % PID_WORD_BITS)));
+        KASSERT(NULL == pid_lookup(pid));
+
+        pid_bitmap[pid / PID_WORD_BITS] &= ~(1U << (pid % PID_WORD_BITS));
+}
+
+void
+pid_hash_insert(proc_t *p)
+{
+        KASSERT(NULL == pid_lookup(p->p_pid));
+
+        list_insert_head(PID_HASH(p->p_pid), &p->p_hash_link);
+}
+
+void
+pid_hash_remove(proc_t *p)
+{
+        KASSERT(list_link_is_linked(&p->p_hash_link));
+
+        list_remove(&p->p_hash_link);
+}
+
+proc_t *
+pid_lookup(pid_t pid)
+{
+        proc_t *p;
+
+        list_iterate_begin(PID_HASH(pid), p, proc_t, p_hash_link) {
+                if (p->p_pid == pid)
+                        return p;
+        } list_iterate_end();
+        return NULL;
+}
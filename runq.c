@@ -0,0 +1,164 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/trace.h"
+#include "util/list.h"
+
+#include "proc/kthread.h"
+#include "proc/runq.h"
+#include "proc/sched.h"
+
+void
+runq_init(ktrunq_t *rq)
+{
+        int i;
+
+        for (i = 0; i < KT_NPRIO; ++i)
+                sched_queue_init(&rq->rq_queues[i]);
+        rq->rq_bitmap = 0;
+        rq->rq_size = 0;
+        rq->rq_ticks = 0;
+}
+
+int
+runq_empty(ktrunq_t *rq)
+{
+        return 0 == rq->rq_bitmap;
+}
+
+static void
+runq_insert(ktrunq_t *rq, kthread_t *thr, int head)
+{
+        ktqueue_t *q;
+
+        KASSERT(thr->kt_prio >= KT_PRIO_MAX && thr->kt_prio <= KT_PRIO_MIN);
+
+        q = &rq->rq_queues[thr->kt_prio];
+        if (head)
+                ktqueue_enqueue_head(q, thr);
+        else
+                ktqueue_enqueue(q, thr);
+        thr->kt_runqstamp = rq->rq_ticks;
+
+        rq->rq_bitmap |= 1U << thr->kt_prio;
+        rq->rq_size++;
+}
+
+void
+runq_enqueue(ktrunq_t *rq, kthread_t *thr)
+{
+        runq_insert(rq, thr, 0);
+}
+
+void
+runq_enqueue_head(ktrunq_t *rq, kthread_t *thr)
+{
+        runq_insert(rq, thr, 1);
+}
+
+void
+runq_remove(ktrunq_t *rq, kthread_t *thr)
+{
+        ktqueue_t *q = &rq->rq_queues[thr->kt_prio];
+
+        ktqueue_remove(q, thr);
+        if (0 == q->tq_size)
+                rq->rq_bitmap &= ~(1U << thr->kt_prio);
+        rq->rq_size--;
+}
+
+/*
+ * Moves a queued thread to another level. It is still waiting for a
+ * CPU, so this does not count as the end of a wait like
+ * runq_remove() followed by runq_insert() would.
+ */
+static void
+runq_move(ktrunq_t *rq, kthread_t *thr, int prio)
+{
+        ktqueue_t *from = &rq->rq_queues[thr->kt_prio];
+
+        KASSERT(prio >= KT_PRIO_MAX && prio <= KT_PRIO_MIN);
+
+        ktqueue_move(from, &rq->rq_queues[prio], thr);
+        if (0 == from->tq_size)
+                rq->rq_bitmap &= ~(1U << thr->kt_prio);
+        thr->kt_prio = prio;
+        thr->kt_runqstamp = rq->rq_ticks;
+        rq->rq_bitmap |= 1U << prio;
+}
+
+kthread_t *
+runq_dequeue(ktrunq_t *rq)
+{
+        kthread_t *thr;
+
+        if (runq_empty(rq))
+                return NULL;
+
+        /* lowest set bit is the most urgent non-empty level */
+        thr = list_head(&rq->rq_queues[__builtin_ctz(rq->rq_bitmap)].tq_list,
+                        kthread_t, kt_qlink);
+        runq_remove(rq, thr);
+        thr->kt_prio = KT_EFFECTIVE_PRIO(thr);
+        return thr;
+}
+
+void
+runq_setprio(ktrunq_t *rq, kthread_t *thr, int prio)
+{
+        int queued = (thr->kt_wchan == &rq->rq_queues[thr->kt_prio]);
+
+        KASSERT(prio >= KT_PRIO_MAX && prio <= KT_PRIO_MIN);
+
+        if (queued)
+                runq_move(rq, thr, prio);
+        else
+                thr->kt_prio = prio;
+}
+
+kthread_t *
+runq_steal(ktrunq_t *rq)
+{
+        kthread_t *thr;
+        int prio;
+
+        for (prio = KT_PRIO_MAX; prio < KT_NPRIO; ++prio) {
+                if (rq->rq_queues[prio].tq_size < 2)
+                        continue;
+
+                thr = list_tail(&rq->rq_queues[prio].tq_list, kthread_t, kt_qlink);
+                runq_remove(rq, thr);
+                /* Aging applied to this queue; it starts over on the new one */
+                thr->kt_prio = KT_EFFECTIVE_PRIO(thr);
+                return thr;
+        }
+        return NULL;
+}
+
+/*
+ * Only the head of each level is looked at, since it is the thread that
+ * has waited longest there. That keeps a tick O(KT_NPRIO) no matter how
+ * many threads are runnable, and every waiting thread still reaches the
+ * head of its level eventually.
+ */
+void
+runq_tick(ktrunq_t *rq)
+{
+        kthread_t *thr;
+        int prio;
+
+        rq->rq_ticks++;
+        for (prio = KT_PRIO_MAX + 1; prio < KT_NPRIO; ++prio) {
+                if (!(rq->rq_bitmap & (1U << prio)))
+                        continue;
+
+                thr = list_head(&rq->rq_queues[prio].tq_list, kthread_t, kt_qlink);
+                if (rq->rq_ticks - thr->kt_runqstamp < RUNQ_AGE_TICKS)
+                        continue;
+
+                runq_move(rq, thr, prio - 1);
+                dbgt(DBG_SCHED, "aged thread %p up to priority %d\n",
+                     (uint32_t)thr, thr->kt_prio);
+        }
+}
@@ -0,0 +1,101 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "api/exec.h"
+
+#include "util/debug.h"
+
+#include "proc/fdtable.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+/*
+ * Shared between do_spawn and the new process's first thread. It lives
+ * on the parent's stack, which is fine because the parent does not
+ * return until the child is done with it.
+ */
+typedef struct spawn_args {
+        const char     *sa_filename;
+        char *const    *sa_argv;
+        char *const    *sa_envp;
+        int             sa_done;        /* child has finished with us */
+        int             sa_err;         /* what do_execve returned */
+        ktqueue_t       sa_waitq;       /* parent waits here for sa_done */
+} spawn_args_t;
+
+/*
+ * The first thread of a spawned process. It loads the new image while
+ * the parent's arguments are still around, lets the parent go, and
+ * only then drops to user mode.
+ */
+static void *
+spawn_exec(int arg1, void *arg2)
+{
+        spawn_args_t *sa = arg2;
+        regs_t regs;
+        int err;
+
+        err = do_execve(sa->sa_filename, sa->sa_argv, sa->sa_envp, &regs);
+
+        sa->sa_err = err;
+        sa->sa_done = 1;
+        sched_wakeup_on(&sa->sa_waitq);
+        /* sa must not be touched after this, the parent may be gone */
+
+        if (err < 0)
+                do_exit(1);
+        userland_entry(regs);
+        panic("Should never get here! userland_entry() does not return.");
+        return NULL;
+}
+
+/*
+ * The child starts out with a fresh thread from kthread_create and
+ * shares our file table, so neither the thread nor the address space
+ * is cloned only to be thrown away by exec.
+ */
+int
+do_spawn(const char *filename, char *const *argv, char *const *envp)
+{
+        spawn_args_t sa;
+        proc_t *child;
+        kthread_t *thr;
+        pid_t pid;
+        int status;
+
+        KASSERT(NULL != filename);
+
+        if (NULL == (child = proc_create((char *)filename)))
+                return -ENOMEM;
+        pid = child->p_pid;
+
+        fdtable_put(child->p_files);
+        child->p_files = fdtable_fork(curproc->p_files);
+
+        sa.sa_filename = filename;
+        sa.sa_argv = argv;
+        sa.sa_envp = envp;
+        sa.sa_done = 0;
+        sa.sa_err = 0;
+        sched_queue_init(&sa.sa_waitq);
+
+        thr = kthread_create(child, spawn_exec, 0, &sa);
+        KASSERT(NULL != thr);
+        sched_make_runnable(thr);
+
+        while (!sa.sa_done)
+                sched_sleep_on(&sa.sa_waitq);
+        ktqueue_stats_fini(&sa.sa_waitq);
+
+        if (sa.sa_err < 0) {
+                /* There is no child as far as our caller is concerned */
+                do_waitpid(pid, 0, &status);
+                return sa.sa_err;
+        }
+
+        dbg(DBG_EXEC, "spawned %s as process %d\n", filename, pid);
+        return pid;
+}
@@ -0,0 +1,157 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+
+#include "proc/kthread.h"
+#include "proc/sched.h"
+#include "proc/timer.h"
+
+uint32_t timer_now = 0;
+static list_t timer_wheel[TIMER_WHEEL_SLOTS];
+
+#define TIMER_SLOT(tick) (&timer_wheel[(tick) & (TIMER_WHEEL_SLOTS - 1)])
+
+void
+timer_init()
+{
+        int i;
+
+        KASSERT(0 == (TIMER_WHEEL_SLOTS & (TIMER_WHEEL_SLOTS - 1)));
+        for (i = 0; i < TIMER_WHEEL_SLOTS; ++i)
+                list_init(&timer_wheel[i]);
+}
+init_func(timer_init);
+
+void
+ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg)
+{
+        list_link_init(&t->t_link);
+        t->t_expires = 0;
+        t->t_func = func;
+        t->t_arg = arg;
+}
+
+void
+ktimer_add(ktimer_t *t, uint32_t ticks)
+{
+        uint8_t oldipl = intr_getipl();
+
+        KASSERT(ticks > 0);
+        KASSERT(!list_link_is_linked(&t->t_link));
+
+        intr_setipl(IPL_HIGH);
+        t->t_expires = timer_now + ticks;
+        list_insert_tail(TIMER_SLOT(t->t_expires), &t->t_link);
+        intr_setipl(oldipl);
+}
+
+int
+ktimer_del(ktimer_t *t)
+{
+        uint8_t oldipl = intr_getipl();
+        int pending;
+
+        intr_setipl(IPL_HIGH);
+        if ((pending = list_link_is_linked(&t->t_link)))
+                list_remove(&t->t_link);
+        intr_setipl(oldipl);
+        return pending;
+}
+
+/*
+ * A slot holds every timer whose expiry is congruent to it, so timers
+ * more than one trip around the wheel away are skipped until their
+ * round comes up.
+ */
+void
+timer_tick()
+{
+        ktimer_t *t;
+
+        timer_now++;
+        list_iterate_begin(TIMER_SLOT(timer_now), t, ktimer_t, t_link) {
+                if (t->t_expires != timer_now)
+                        continue;
+                list_remove(&t->t_link);
+                t->t_func(t->t_arg);
+        } list_iterate_end();
+}
+
+/* ------------------------------------------------------------------ */
+/* -------------------------- TIMED SLEEPS -------------------------- */
+/* ------------------------------------------------------------------ */
+
+typedef struct sched_timeout {
+        ktimer_t        st_timer;
+        kthread_t      *st_thr;
+        ktqueue_t      *st_q;           /* the queue st_thr sleeps on */
+        int             st_expired;     /* 1 if the timer, not a wakeup, woke us */
+} sched_timeout_t;
+
+static void
+sched_timeout_expired(void *arg)
+{
+        sched_timeout_t *st = arg;
+        kthread_t *thr = st->st_thr;
+
+        /*
+         * Already woken up, the sleeper will cancel us. Once woken the
+         * thread may be on a run queue, so kt_wchan need not be NULL.
+         */
+        if (thr->kt_wchan != st->st_q)
+                return;
+
+        ktqueue_remove(st->st_q, thr);
+        st->st_expired = 1;
+        sched_make_runnable(thr);
+}
+
+/*
+ * The interrupt level stays raised from arming the timer until we are
+ * on the queue, otherwise a timer firing in between would find nothing
+ * to wake and we would sleep forever.
+ */
+static int
+sched_timed_sleep(ktqueue_t *q, uint32_t ticks, int cancellable)
+{
+        sched_timeout_t st;
+        uint8_t oldipl = intr_getipl();
+        int ret = 0;
+
+        st.st_thr = curthr;
+        st.st_q = q;
+        st.st_expired = 0;
+        ktimer_init(&st.st_timer, sched_timeout_expired, &st);
+
+        intr_setipl(IPL_HIGH);
+        ktimer_add(&st.st_timer, ticks);
+        if (cancellable)
+                ret = sched_cancellable_sleep_on(q);
+        else
+                sched_sleep_on(q);
+        ktimer_del(&st.st_timer);
+        intr_setipl(oldipl);
+
+        if (0 == ret && st.st_expired)
+                ret = -ETIMEDOUT;
+        return ret;
+}
+
+int
+sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_timed_sleep(q, ticks, 0);
+}
+
+int
+sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_timed_sleep(q, ticks, 1);
+}
@@ -0,0 +1,86 @@
+#include "config.h"
+#include "globals.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/trace.h"
+
+#include "proc/cpu.h"
+
+typedef struct trace_ring {
+        volatile uint32_t tr_head;      /* records ever written */
+        trace_rec_t       tr_recs[TRACE_RING_SIZE];
+} trace_ring_t;
+
+uint64_t trace_modes = 0;
+
+static trace_ring_t trace_rings[NCPUS];
+
+#define TRACE_SLOT(ring, idx) (&(ring)->tr_recs[(idx) & (TRACE_RING_SIZE - 1)])
+
+/*
+ * Each ring has a single writer, its CPU, but an interrupt can trace
+ * in the middle of a thread's trace_record. Claiming the slot with an
+ * atomic increment gives the two different slots, and the sequence
+ * number, written last, tells the reader when a slot is complete.
+ */
+void
+trace_record(const trace_site_t *site, const uint32_t *args)
+{
+        trace_ring_t *ring = &trace_rings[curcpu()->cpu_id];
+        uint32_t idx = __sync_fetch_and_add(&ring->tr_head, 1);
+        trace_rec_t *rec = TRACE_SLOT(ring, idx);
+        int i;
+
+        rec->tr_seq = 0;
+        __sync_synchronize();
+        rec->tr_site = site;
+        rec->tr_stamp = trace_cycles();
+        for (i = 0; i < TRACE_NARGS; ++i)
+                rec->tr_args[i] = args[i];
+        __sync_synchronize();
+        rec->tr_seq = idx + 1;
+}
+
+size_t
+trace_info(const void *arg, char *buf, size_t osize)
+{
+        uint32_t cpu = (uint32_t)arg;
+        trace_ring_t *ring;
+        trace_rec_t rec;
+        uint32_t idx, head;
+        size_t size = osize;
+
+        KASSERT(cpu < NCPUS);
+        ring = &trace_rings[cpu];
+
+        head = ring->tr_head;
+        idx = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (; idx != head && size > 1; ++idx) {
+                rec = *TRACE_SLOT(ring, idx);
+                __sync_synchronize();
+                /* Skip records still being written or already overwritten */
+                if (rec.tr_seq != idx + 1 || TRACE_SLOT(ring, idx)->tr_seq != idx + 1)
+                        continue;
+
+                iprintf(&buf, &size, "%08x%08x %s:%d %s(): ",
+                        (uint32_t)(rec.tr_stamp >> 32), (uint32_t)rec.tr_stamp,
+                        rec.tr_site->ts_file, rec.tr_site->ts_line,
+                        rec.tr_site->ts_func);
+                iprintf(&buf, &size, (char *)rec.tr_site->ts_fmt,
+                        rec.tr_args[0], rec.tr_args[1],
+                        rec.tr_args[2], rec.tr_args[3]);
+        }
+        return size;
+}
+
+void
+trace_dump(void)
+{
+        uint32_t cpu;
+
+        for (cpu = 0; cpu < NCPUS; ++cpu) {
+                if (trace_rings[cpu].tr_head > 0)
+                        dbg_printinfo(trace_info, (const void *)cpu);
+        }
+}
@@ -0,0 +1,47 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+/*
+ * A supervisor with many children can collect every one that has died
+ * with one call and at most one sleep on p_wait, instead of going
+ * around do_waitpid once per child. Each pass over p_children hands
+ * the dead children it finds straight to proc_reap, so collecting k
+ * of N children is one O(N) walk rather than k of them.
+ */
+int
+do_waitpid_n(int options, pid_t *pids, int *statuses, int n)
+{
+        proc_t *child;
+        int count;
+
+        KASSERT(NULL != pids && NULL != statuses && n > 0);
+
+        if (options & ~WNOHANG)
+                return -EINVAL;
+
+        for (;;) {
+                if (list_empty(&curproc->p_children))
+                        return -ECHILD;
+
+                count = 0;
+                list_iterate_begin(&curproc->p_children, child, proc_t, p_child_link) {
+                        if (count < n && PROC_DEAD == child->p_state) {
+                                pids[count] = proc_reap(child, &statuses[count]);
+                                count++;
+                        }
+                } list_iterate_end();
+
+                if (count > 0 || (options & WNOHANG))
+                        return count;
+
+                sched_sleep_on(&curproc->p_wait);
+        }
+}
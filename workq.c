@@ -0,0 +1,148 @@
+#include "config.h"
+#include "globals.h"
+
+#include "errno.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "proc/workq.h"
+
+static proc_t *workq_proc;              /* the process all workers belong to */
+static list_t workq_pending;            /* queued work_ts, linked by w_link */
+static ktqueue_t workq_idleq;           /* idle workers sleep here */
+static int workq_nworkers = 0;
+static int workq_nidle = 0;
+
+static void *workq_run(int arg1, void *arg2);
+
+void
+work_init(work_t *w, work_func_t func, void *arg)
+{
+        list_link_init(&w->w_link);
+        w->w_func = func;
+        w->w_arg = arg;
+        w->w_queued = 0;
+}
+
+int
+workq_queue(work_t *w)
+{
+        uint8_t oldipl = intr_getipl();
+
+        intr_setipl(IPL_HIGH);
+        if (w->w_queued) {
+                intr_setipl(oldipl);
+                return 0;
+        }
+        w->w_queued = 1;
+        list_insert_tail(&workq_pending, &w->w_link);
+        if (workq_nidle > 0)
+                sched_wakeup_on(&workq_idleq);
+        intr_setipl(oldipl);
+        return 1;
+}
+
+int
+workq_cancel(work_t *w)
+{
+        uint8_t oldipl = intr_getipl();
+        int cancelled = 0;
+
+        intr_setipl(IPL_HIGH);
+        if (w->w_queued) {
+                list_remove(&w->w_link);
+                w->w_queued = 0;
+                cancelled = 1;
+        }
+        intr_setipl(oldipl);
+        return cancelled;
+}
+
+static void
+workq_start(kthread_t *thr)
+{
+#ifdef __MTP__
+        /* Workers that exit are freed by the reaper */
+        kthread_detach(thr);
+#endif
+        workq_nworkers++;
+        sched_make_runnable(thr);
+}
+
+/* Only called from thread context, never from an interrupt */
+static void
+workq_grow(void)
+{
+#ifdef __MTP__
+        kthread_t *thr;
+
+        if (workq_nworkers >= WORKQ_MAX_WORKERS)
+                return;
+
+        /* kthread_create_stack does not fail, it KASSERTs on OOM */
+        thr = kthread_create_stack(workq_proc, workq_run, 0, NULL, KT_STACK_MEDIUM);
+        workq_start(thr);
+#endif
+}
+
+static void *
+workq_run(int arg1, void *arg2)
+{
+        uint8_t oldipl;
+        work_t *w;
+        int ret;
+
+        for (;;) {
+                oldipl = intr_getipl();
+                intr_setipl(IPL_HIGH);
+                while (list_empty(&workq_pending)) {
+                        workq_nidle++;
+                        ret = sched_sleep_on_timeout(&workq_idleq, WORKQ_IDLE_TICKS);
+                        workq_nidle--;
+
+                        if (-ETIMEDOUT == ret && list_empty(&workq_pending) &&
+                            workq_nworkers > WORKQ_MIN_WORKERS) {
+                                workq_nworkers--;
+                                intr_setipl(oldipl);
+                                return NULL;
+                        }
+                }
+                w = list_head(&workq_pending, work_t, w_link);
+                list_remove(&w->w_link);
+                w->w_queued = 0;
+                intr_setipl(oldipl);
+
+                /* More work than workers to do it: get some help */
+                if (!list_empty(&workq_pending) && 0 == workq_nidle)
+                        workq_grow();
+
+                w->w_func(w->w_arg);
+        }
+        return NULL;
+}
+
+static __attribute__((unused)) void
+workq_init()
+{
+        kthread_t *thr;
+
+        list_init(&workq_pending);
+        sched_queue_init(&workq_idleq);
+
+        workq_proc = proc_create("workq");
+        KASSERT(NULL != workq_proc);
+
+        thr = kthread_create_stack(workq_proc, workq_run, 0, NULL, KT_STACK_MEDIUM);
+        KASSERT(NULL != thr);
+        workq_start(thr);
+}
+init_func(workq_init);
+init_depends(sched_init);
+init_depends(cpu_init);